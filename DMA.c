@@ -6,30 +6,51 @@
 
 #include "FreeRTOSConfig.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "DMA.h"
 #include "DMAconfig.h"
+#include "DMAtrace.h"
+#if DMA_USE_VIRTUAL_CHANNELS
+#include "DMAvirtual.h"
+#endif
 
 uint32_t DMA_available[DMA_CHANNELCOUNT] = {[0 ... (DMA_CHANNELCOUNT-1)] = 1};
-DMAISR_t DMA_irqHandler[DMA_CHANNELCOUNT] = {[0 ... (DMA_CHANNELCOUNT-1)].handler = NULL, [0 ... (DMA_CHANNELCOUNT-1)].handle = NULL};
+DMAISR_t DMA_irqHandler[DMA_CHANNELCOUNT] = {[0 ... (DMA_CHANNELCOUNT-1)].handler = NULL, [0 ... (DMA_CHANNELCOUNT-1)].handle = NULL, [0 ... (DMA_CHANNELCOUNT-1)].deferred = 0, [0 ... (DMA_CHANNELCOUNT-1)].pinned = 0};
+volatile uint32_t DMA_isrNesting = 0;
 
 static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch);
 
+#if DMA_USE_DEFERRED_EVENTS
+static void DMA_dropEvents(uint32_t ch);
+#else
+#define DMA_dropEvents(ch)
+#endif
+
 uint32_t DMA_setIRQHandler(DmaHandle_t * handle, DMAIRQHandler_t handlerFunction, void * data){
+    //handler and data must change together, otherwise an interrupt in between calls one with the data of the other.
+    //Events still queued for the event task belonged to the old handler, so they go as well. An event the task is handling right now still finishes with the old one
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
     DMA_irqHandler[handle->moduleID].handler = handlerFunction;
     DMA_irqHandler[handle->moduleID].data = data;
+    DMA_dropEvents(handle->moduleID);
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
     
     //was a handler just removed? If so clear the iec bit
     if(handlerFunction == NULL) DMA_setIRQEnabled(handle, 0);
+    
+    return 1;
 }
 
 uint32_t DMA_setSrcConfig(DmaHandle_t * handle, uint32_t * src, uint32_t size){
     DCHSSA = KVA_TO_PA(src);
     DCHSSIZ = size;
+    DMA_TRACE(DMA_TRACE_EVT_CFG_SRC, handle->moduleID, size, KVA_TO_PA(src));
 }
 
 uint32_t DMA_setDestConfig(DmaHandle_t * handle, uint32_t * dest, uint32_t size){
     DCHDSA = KVA_TO_PA(dest);
     DCHDSIZ = size;
+    DMA_TRACE(DMA_TRACE_EVT_CFG_DST, handle->moduleID, size, KVA_TO_PA(dest));
 }
 
 uint32_t DMA_setTransferAttributes(DmaHandle_t * handle, int32_t cellSize, int32_t startISR, int32_t abortISR){
@@ -56,6 +77,7 @@ uint32_t DMA_setTransferAttributes(DmaHandle_t * handle, int32_t cellSize, int32
     }
     
     DCHECON = temp;
+    DMA_TRACE(DMA_TRACE_EVT_CFG_XFER, handle->moduleID, DCHCSIZ, temp);
 }
 
 uint32_t DMA_setChannelAttributes(DmaHandle_t * handle, int32_t enableChaining, int32_t chainDir, int32_t evtIfDisabled, int32_t autoEn, int32_t prio){
@@ -79,6 +101,7 @@ uint32_t DMA_setChannelAttributes(DmaHandle_t * handle, int32_t enableChaining,
     }
     
     DCHCON = temp;
+    DMA_TRACE(DMA_TRACE_EVT_CFG_CHAN, handle->moduleID, 0, temp);
 }
 
 uint32_t DMA_setIRQEnabled(DmaHandle_t * handle, int32_t enabled){
@@ -92,76 +115,81 @@ uint32_t DMA_setIRQEnabled(DmaHandle_t * handle, int32_t enabled){
 
 uint32_t DMA_setInterruptConfig(DmaHandle_t * handle, int32_t srcDoneEN, int32_t srcHalfEmptyEN, int32_t dstDoneEN, 
                                         int32_t dstHalfFullEN, int32_t blockDoneEN, int32_t cellDoneEN, int32_t abortEN, int32_t errorEN){
-    uint32_t temp = DCHINT;
+    //only goes through INTCLR/INTSET. Writing back INT could clear a flag the hardware set between the read and the write, and that event would be lost
+    uint32_t set = 0;
+    uint32_t clr = 0;
     
     //figure out which enable bits need to be changed and which ones left alone
     //also make sure to also clear the flags of any interrupts that were just enabled 
     if(srcDoneEN != -1){
         if(srcDoneEN){ 
-            temp |= _DCH0INT_CHSDIE_MASK; 
-            temp &= ~_DCH0INT_CHSDIF_MASK;
+            set |= _DCH0INT_CHSDIE_MASK; 
+            clr |= _DCH0INT_CHSDIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHSDIE_MASK;
+            clr |= _DCH0INT_CHSDIE_MASK;
         }
     }
     if(srcHalfEmptyEN != -1){
         if(srcHalfEmptyEN){
-            temp |= _DCH0INT_CHSHIE_MASK; 
-            temp &= ~_DCH0INT_CHSHIF_MASK;
+            set |= _DCH0INT_CHSHIE_MASK; 
+            clr |= _DCH0INT_CHSHIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHSHIE_MASK;
+            clr |= _DCH0INT_CHSHIE_MASK;
         }
     }
     if(dstDoneEN != -1){
         if(dstDoneEN){
-            temp |= _DCH0INT_CHDDIE_MASK; 
-            temp &= ~_DCH0INT_CHDDIF_MASK;
+            set |= _DCH0INT_CHDDIE_MASK; 
+            clr |= _DCH0INT_CHDDIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHDDIE_MASK;
+            clr |= _DCH0INT_CHDDIE_MASK;
         }
     }
     if(dstHalfFullEN != -1){
         if(dstHalfFullEN){
-            temp |= _DCH0INT_CHDHIE_MASK; 
-            temp &= ~_DCH0INT_CHDHIF_MASK;
+            set |= _DCH0INT_CHDHIE_MASK; 
+            clr |= _DCH0INT_CHDHIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHDHIE_MASK;
+            clr |= _DCH0INT_CHDHIE_MASK;
         }
     }
     if(blockDoneEN != -1){
         if(blockDoneEN){
-            temp |= _DCH0INT_CHBCIE_MASK; 
-            temp &= ~_DCH0INT_CHBCIF_MASK;
+            set |= _DCH0INT_CHBCIE_MASK; 
+            clr |= _DCH0INT_CHBCIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHBCIE_MASK;
+            clr |= _DCH0INT_CHBCIE_MASK;
         }
     }
     if(cellDoneEN != -1){
         if(cellDoneEN){
-            temp |= _DCH0INT_CHCCIE_MASK; 
-            temp &= ~_DCH0INT_CHCCIF_MASK;
+            set |= _DCH0INT_CHCCIE_MASK; 
+            clr |= _DCH0INT_CHCCIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHCCIE_MASK;
+            clr |= _DCH0INT_CHCCIE_MASK;
         }
     }
     if(abortEN != -1){
         if(abortEN){
-            temp |= _DCH0INT_CHTAIE_MASK; 
-            temp &= ~_DCH0INT_CHTAIF_MASK;
+            set |= _DCH0INT_CHTAIE_MASK; 
+            clr |= _DCH0INT_CHTAIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHTAIE_MASK;
+            clr |= _DCH0INT_CHTAIE_MASK;
         }
     }
     if(errorEN != -1){
         if(errorEN){
-            temp |= _DCH0INT_CHERIE_MASK; 
-            temp &= ~_DCH0INT_CHERIF_MASK;
+            set |= _DCH0INT_CHERIE_MASK; 
+            clr |= _DCH0INT_CHERIF_MASK;
         }else{ 
-            temp &= ~_DCH0INT_CHERIE_MASK;
+            clr |= _DCH0INT_CHERIE_MASK;
         }
     }
     
-    DCHINT = temp;
+    //flags first, so an interrupt that was just enabled doesn't fire for something that happened before
+    DCHINTCLR = clr;
+    DCHINTSET = set;
+    DMA_TRACE(DMA_TRACE_EVT_CFG_INT, handle->moduleID, 0, DCHINT);
 }
 
 inline uint32_t DMA_readISRFlags(DmaHandle_t * handle){
@@ -169,41 +197,135 @@ inline uint32_t DMA_readISRFlags(DmaHandle_t * handle){
 }
 
 DmaHandle_t * DMA_allocateChannel(){
+    //got a free channel? create a handle for it
+    DmaHandle_t * handle = pvPortMalloc(sizeof(DmaHandle_t));
+    if(handle == NULL) return 0;
+    
+    if(!DMA_claimChannel(handle)){ //no free channel found...
+        vPortFree(handle);
+        return 0;
+    }
+    
+    return handle;
+}
+
+uint32_t DMA_claimChannel(DmaHandle_t * handle){
+    //this might get called from an ISR as well (virtual channel scheduler), so no heap in here and make sure the search is atomic
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
     //find a free channel in the channelList
     uint32_t currCh = 0;
     for(; currCh < DMA_CHANNELCOUNT; currCh++){
-        if(DMA_available[currCh]) break;
+        if(DMA_available[currCh] && !DMA_IS_STATIC(currCh)) break;
     }
     
     if(currCh == DMA_CHANNELCOUNT){ //no free channel found...
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
         return 0;
     }
     
-    //got number of the new channel, now create handle
-    DmaHandle_t * handle = pvPortMalloc(sizeof(DmaHandle_t));
-    if(!populateHandle(handle, currCh)){ //no free channel found...
-        vPortFree(handle);
+    //a free channel must not be referenced by anyone anymore
+    configASSERT(DMA_irqHandler[currCh].handle == NULL);
+    
+    DMA_available[currCh] = 0;
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    //got number of the new channel, now fill in the handle
+    if(!populateHandle(handle, currCh)){
+        DMA_available[currCh] = 1;
+        return 0;
+    }
+    
+    DMA_TRACE(DMA_TRACE_EVT_ALLOC, currCh, 0, (uint32_t) handle);
+    return 1;
+}
+
+//allocates two neighbouring channels (ch and ch + 1), chaining only works between those. Returns 0 if no such pair is free
+uint32_t DMA_allocateChannelPair(DmaHandle_t ** low, DmaHandle_t ** high){
+    DmaHandle_t * lowHandle = pvPortMalloc(sizeof(DmaHandle_t));
+    DmaHandle_t * highHandle = pvPortMalloc(sizeof(DmaHandle_t));
+    if(lowHandle == NULL || highHandle == NULL){
+        if(lowHandle != NULL) vPortFree(lowHandle);
+        if(highHandle != NULL) vPortFree(highHandle);
+        return 0;
+    }
+    
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    uint32_t currCh = 0;
+    for(; currCh + 1 < DMA_CHANNELCOUNT; currCh++){
+        if(DMA_available[currCh] && !DMA_IS_STATIC(currCh) && DMA_available[currCh + 1] && !DMA_IS_STATIC(currCh + 1)) break;
+    }
+    
+    if(currCh + 1 >= DMA_CHANNELCOUNT){
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        vPortFree(lowHandle);
+        vPortFree(highHandle);
         return 0;
     }
     
+    configASSERT(DMA_irqHandler[currCh].handle == NULL && DMA_irqHandler[currCh + 1].handle == NULL);
+    
     DMA_available[currCh] = 0;
+    DMA_available[currCh + 1] = 0;
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
     
-    return handle;
+    if(!populateHandle(lowHandle, currCh) || !populateHandle(highHandle, currCh + 1)){
+        DMA_irqHandler[currCh].handle = NULL;
+        DMA_irqHandler[currCh + 1].handle = NULL;
+        DMA_available[currCh] = 1;
+        DMA_available[currCh + 1] = 1;
+        vPortFree(lowHandle);
+        vPortFree(highHandle);
+        return 0;
+    }
+    
+    DMA_TRACE(DMA_TRACE_EVT_ALLOC, currCh, 0, (uint32_t) lowHandle);
+    DMA_TRACE(DMA_TRACE_EVT_ALLOC, currCh + 1, 0, (uint32_t) highHandle);
+    
+    *low = lowHandle;
+    *high = highHandle;
+    return 1;
 }
 
-uint32_t DMA_freeChannel(DmaHandle_t * handle){
+void DMA_releaseChannel(DmaHandle_t * handle){
+    //catches double frees and handles that never owned the channel
+    configASSERT(handle->moduleID < DMA_CHANNELCOUNT);
+    configASSERT(!DMA_available[handle->moduleID] && DMA_irqHandler[handle->moduleID].handle == handle);
+    
+    DMA_TRACE(DMA_TRACE_EVT_FREE, handle->moduleID, 0, 0);
+    
     //abort also clears CHEN
     DMA_abortTransfer(handle);
     
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
     DMA_irqHandler[handle->moduleID].handler = NULL;
     DMA_irqHandler[handle->moduleID].data = NULL;
+    DMA_dropEvents(handle->moduleID);
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    DMA_setIRQEnabled(handle, 0);
     
     DMA_setInterruptConfig(handle, -1, -1, -1, -1, -1, -1, -1, -1); //update IEC register without changing any module enables
     
+    //the channel only becomes available once nothing points to the old handle anymore
+    irqState = taskENTER_CRITICAL_FROM_ISR();
     DMA_irqHandler[handle->moduleID].handle = NULL;
+    DMA_irqHandler[handle->moduleID].deferred = 0;
+    DMA_irqHandler[handle->moduleID].pinned = 0;
     DMA_available[handle->moduleID] = 1;
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+}
+
+uint32_t DMA_freeChannel(DmaHandle_t * handle){
+    DMA_releaseChannel(handle);
     vPortFree(handle);
     
+#if DMA_USE_VIRTUAL_CHANNELS
+    //a hardware channel just became available, let the virtual channel scheduler grab it if it has anything queued
+    DMA_VC_schedule();
+#endif
+    
     return 1;
 }
 //TODO: maybe make this function nestable?
@@ -224,15 +346,17 @@ void DMA_resumeTransfers(){
 
 static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
     handle->moduleID = ch;
-    DMA_irqHandler[handle->moduleID].handle = handle;
     switch(ch){
 #ifdef DCH0CON
         case 0:
             handle->CON = (DCHxCON_t*) &DCH0CON;
+            handle->CONCLR = &DCH0CONCLR;
+            handle->CONSET = &DCH0CONSET;
             handle->ECON = (DCHxECON_t*) &DCH0ECON;
             handle->ECONSET = &DCH0ECONSET;
             handle->INT = (DCHxINT_t*) &DCH0INT;
             handle->INTCLR = &DCH0INTCLR;
+            handle->INTSET = &DCH0INTSET;
             
 
             handle->SSA = &DCH0SSA;
@@ -248,22 +372,25 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH0DAT;
             
-            handle->IECREG = &DMA_IEC;
+            handle->IECREG = &DMA_IECREG(0);
             handle->iecMask = DMA_IEC_BASEMASK << 0;
             handle->isrNumber = _DMA0_IRQ;
             
             DMA_IPC_CH0 = 4;
             DMA_ISPC_CH0 = 3;
             
-            return 1;
+            break;
 #endif
 #ifdef DCH1CON
         case 1:
             handle->CON = (DCHxCON_t*)&DCH1CON;
+            handle->CONCLR = &DCH1CONCLR;
+            handle->CONSET = &DCH1CONSET;
             handle->ECON = (DCHxECON_t*)&DCH1ECON;
             handle->ECONSET = &DCH1ECONSET;
             handle->INT = (DCHxINT_t*)&DCH1INT;
             handle->INTCLR = &DCH1INTCLR;
+            handle->INTSET = &DCH1INTSET;
 
             handle->SSA = &DCH1SSA;
             handle->DSA = &DCH1DSA;
@@ -278,21 +405,24 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH1DAT;
             
-            handle->IECREG = &DMA_IEC;
+            handle->IECREG = &DMA_IECREG(1);
             handle->iecMask = DMA_IEC_BASEMASK << 1;
             handle->isrNumber = _DMA1_IRQ;
             
             DMA_IPC_CH1 = 4;
             DMA_ISPC_CH1 = 3;
-            return 1;
+            break;
 #endif
 #ifdef DCH2CON
         case 2:
             handle->CON = (DCHxCON_t*)&DCH2CON;
+            handle->CONCLR = &DCH2CONCLR;
+            handle->CONSET = &DCH2CONSET;
             handle->ECON = (DCHxECON_t*)&DCH2ECON;
             handle->ECONSET = &DCH2ECONSET;
             handle->INT = (DCHxINT_t*)&DCH2INT;
             handle->INTCLR = &DCH2INTCLR;
+            handle->INTSET = &DCH2INTSET;
 
             handle->SSA = &DCH2SSA;
             handle->DSA = &DCH2DSA;
@@ -307,21 +437,24 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH2DAT;
             
-            handle->IECREG = &DMA_IEC;
+            handle->IECREG = &DMA_IECREG(2);
             handle->iecMask = DMA_IEC_BASEMASK << 2;
             handle->isrNumber = _DMA2_IRQ;
             
             DMA_IPC_CH2 = 4;
             DMA_ISPC_CH2 = 3;
-            return 1;
+            break;
 #endif
 #ifdef DCH3CON
         case 3:
             handle->CON = (DCHxCON_t*)&DCH3CON;
+            handle->CONCLR = &DCH3CONCLR;
+            handle->CONSET = &DCH3CONSET;
             handle->ECON = (DCHxECON_t*)&DCH3ECON;
             handle->ECONSET = &DCH3ECONSET;
             handle->INT = (DCHxINT_t*)&DCH3INT;
             handle->INTCLR = &DCH3INTCLR;
+            handle->INTSET = &DCH3INTSET;
 
             handle->SSA = &DCH3SSA;
             handle->DSA = &DCH3DSA;
@@ -336,21 +469,24 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH3DAT;
             
-            handle->IECREG = &DMA_IEC;
+            handle->IECREG = &DMA_IECREG(3);
             handle->iecMask = DMA_IEC_BASEMASK << 3;
             handle->isrNumber = _DMA3_IRQ;
             
             DMA_IPC_CH3 = 4;
             DMA_ISPC_CH3 = 3;
-            return 1;
+            break;
 #endif
 #ifdef DCH4CON
         case 4:
             handle->CON = (DCHxCON_t*)&DCH4CON;
+            handle->CONCLR = &DCH4CONCLR;
+            handle->CONSET = &DCH4CONSET;
             handle->ECON = (DCHxECON_t*)&DCH4ECON;
             handle->ECONSET = &DCH4ECONSET;
             handle->INT = (DCHxINT_t*)&DCH4INT;
             handle->INTCLR = &DCH4INTCLR;
+            handle->INTSET = &DCH4INTSET;
 
             handle->SSA = &DCH4SSA;
             handle->DSA = &DCH4DSA;
@@ -365,20 +501,23 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH4DAT;
             
-            handle->IECREG = &IEC4;
+            handle->IECREG = &DMA_IECREG(4);
             handle->iecMask = DMA_IEC_BASEMASK << 4;
             
             DMA_IPC_CH4 = 4;
             DMA_ISPC_CH4 = 3;
-            return 1;
+            break;
 #endif
 #ifdef DCH5CON
         case 5:
             handle->CON = (DCHxCON_t*)&DCH5CON;
+            handle->CONCLR = &DCH5CONCLR;
+            handle->CONSET = &DCH5CONSET;
             handle->ECON = (DCHxECON_t*)&DCH5ECON;
             handle->ECONSET = &DCH5ECONSET;
             handle->INT = (DCHxINT_t*)&DCH5INT;
             handle->INTCLR = &DCH5INTCLR;
+            handle->INTSET = &DCH5INTSET;
 
             handle->SSA = &DCH5SSA;
             handle->DSA = &DCH5DSA;
@@ -393,20 +532,23 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH5DAT;
             
-            handle->IECREG = &IEC4;
+            handle->IECREG = &DMA_IECREG(5);
             handle->iecMask = DMA_IEC_BASEMASK << 5;
             
             DMA_IPC_CH5 = 4;
             DMA_ISPC_CH5 = 3;
-            return 1;
+            break;
 #endif
 #ifdef DCH6CON
         case 6:
             handle->CON = (DCHxCON_t*)&DCH6CON;
+            handle->CONCLR = &DCH6CONCLR;
+            handle->CONSET = &DCH6CONSET;
             handle->ECON = (DCHxECON_t*)&DCH6ECON;
             handle->ECONSET = &DCH6ECONSET;
             handle->INT = (DCHxINT_t*)&DCH6INT;
             handle->INTCLR = &DCH6INTCLR;
+            handle->INTSET = &DCH6INTSET;
 
             handle->SSA = &DCH6SSA;
             handle->DSA = &DCH6DSA;
@@ -421,20 +563,23 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH6DAT;
             
-            handle->IECREG = &IEC4;
+            handle->IECREG = &DMA_IECREG(6);
             handle->iecMask = DMA_IEC_BASEMASK << 6;
             
             DMA_IPC_CH6 = 4;
             DMA_ISPC_CH6 = 3;
-            return 1;
+            break;
 #endif
 #ifdef DCH7CON
         case 7:
             handle->CON = (DCHxCON_t*)&DCH7CON;
+            handle->CONCLR = &DCH7CONCLR;
+            handle->CONSET = &DCH7CONSET;
             handle->ECON = (DCHxECON_t*)&DCH7ECON;
             handle->ECONSET = &DCH7ECONSET;
             handle->INT = (DCHxINT_t*)&DCH7INT;
             handle->INTCLR = &DCH7INTCLR;
+            handle->INTSET = &DCH7INTSET;
 
             handle->SSA = &DCH7SSA;
             handle->DSA = &DCH7DSA;
@@ -449,99 +594,202 @@ static uint32_t populateHandle(DmaHandle_t * handle, uint32_t ch){
 
             handle->DAT = &DCH7DAT;
             
-            handle->IECREG = &IEC4;
+            handle->IECREG = &DMA_IECREG(7);
             handle->iecMask = DMA_IEC_BASEMASK << 7;
             
             DMA_IPC_CH7 = 4;
             DMA_ISPC_CH7 = 3;
-            return 1;
+            break;
 #endif
         default:
             return 0;
     }
+    
+    //only publish the handle once it's complete, the isr of the channel might already look at it
+    __atomic_store_n(&DMA_irqHandler[ch].handle, handle, __ATOMIC_RELEASE);
+    return 1;
 }
 
 
-#ifdef DCH0CON
-void __ISR(_DMA0_VECTOR) DMA0ISR(){
-    DMA_IFSCLR = _IFS1_DMA0IF_MASK << 0;
-    uint32_t evt = DMA_irqHandler[0].handle->INT->w;
-    *(DMA_irqHandler[0].handle->INTCLR) = 0xff;
+#if DMA_USE_DEFERRED_EVENTS
+//filled by the DMA ISRs, emptied by the event task. All DMA ISRs run at the same IPL and can't preempt each other, so there is only ever one producer
+static DMA_Event_t DMA_eventQueue[DMA_EVENTQUEUE_SIZE];
+static volatile uint32_t DMA_eventHead = 0;
+static volatile uint32_t DMA_eventTail = 0;
+static volatile uint32_t DMA_eventOverflows = 0;
+static uint32_t DMA_currentEventTimestamp = 0;
+static TaskHandle_t DMA_eventTask = NULL;
+
+static void DMA_eventTaskFunction(void * params);
+
+uint32_t DMA_setIRQDeferred(DmaHandle_t * handle, uint32_t deferred){
+    if(deferred && DMA_irqHandler[handle->moduleID].pinned) return 0;
+    DMA_irqHandler[handle->moduleID].deferred = deferred;
+    return 1;
+}
+
+uint32_t DMA_pinIRQ(DmaHandle_t * handle){
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    DMA_irqHandler[handle->moduleID].pinned = 1;
+    DMA_irqHandler[handle->moduleID].deferred = 0;
+    DMA_dropEvents(handle->moduleID);
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    return 1;
+}
+
+uint32_t DMA_startEventTask(uint32_t priority){
+    if(DMA_eventTask != NULL){
+        vTaskPrioritySet(DMA_eventTask, priority);
+        return 1;
+    }
     
-    if(DMA_irqHandler[0].handler != NULL){
-        (*(DMA_irqHandler[0].handler))(evt, DMA_irqHandler[0].data);
+    return xTaskCreate(DMA_eventTaskFunction, "DMAevt", DMA_EVENTTASK_STACKSIZE, NULL, priority, &DMA_eventTask) == pdPASS;
+}
+
+uint32_t DMA_getEventTimestamp(){
+    return DMA_currentEventTimestamp;
+}
+
+uint32_t DMA_getEventQueueOverflows(){
+    return DMA_eventOverflows;
+}
+
+static inline uint32_t DMA_queueEvent(uint32_t ch, uint32_t evt){
+    uint32_t head = DMA_eventHead;
+    uint32_t next = (head + 1) & (DMA_EVENTQUEUE_SIZE - 1);
+    
+    //queue full? Then the caller handles the event right away instead of losing it
+    if(next == DMA_eventTail){
+        DMA_eventOverflows++;
+        return 0;
+    }
+    
+    DMA_eventQueue[head].channel = ch;
+    DMA_eventQueue[head].evt = evt;
+    DMA_eventQueue[head].timestamp = _CP0_GET_COUNT();
+    
+    //only publish the entry once it is complete
+    DMA_eventHead = next;
+    
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(DMA_eventTask, &xHigherPriorityTaskWoken);
+    portEND_SWITCHING_ISR( xHigherPriorityTaskWoken );
+    
+    return 1;
+}
+
+//marks all queued events of a channel as dropped, the event task skips them. Must be called with interrupts disabled
+static void DMA_dropEvents(uint32_t ch){
+    for(uint32_t i = DMA_eventTail; i != DMA_eventHead; i = (i + 1) & (DMA_EVENTQUEUE_SIZE - 1)){
+        if(DMA_eventQueue[i].channel == ch) DMA_eventQueue[i].channel = DMA_CHANNELCOUNT;
+    }
+}
+
+static void DMA_eventTaskFunction(void * params){
+    while(1){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        //drain everything that accumulated since we last ran in one go
+        while(1){
+            //take the event together with the handler it goes to, so neither can change under us (see DMA_setIRQHandler)
+            taskENTER_CRITICAL();
+            uint32_t tail = DMA_eventTail;
+            if(tail == DMA_eventHead){
+                taskEXIT_CRITICAL();
+                break;
+            }
+            
+            DMA_Event_t event = DMA_eventQueue[tail];
+            DMAIRQHandler_t handler = NULL;
+            void * data = NULL;
+            if(event.channel < DMA_CHANNELCOUNT){
+                handler = DMA_irqHandler[event.channel].handler;
+                data = DMA_irqHandler[event.channel].data;
+            }
+            
+            DMA_eventTail = (tail + 1) & (DMA_EVENTQUEUE_SIZE - 1);
+            taskEXIT_CRITICAL();
+            
+            DMA_currentEventTimestamp = event.timestamp;
+            if(handler != NULL) (*handler)(event.evt, data);
+        }
     }
 }
 #endif
 
-#ifdef DCH1CON
+//common part of all channel ISRs: snapshot and clear the flags, then either run the handler or hand the event to the event task
+static inline void DMA_dispatchIRQ(uint32_t ch){
+    DMAISR_t * isr = &DMA_irqHandler[ch];
+    if(isr->handle == NULL) return;
+    
+    //only clear what we're about to handle, a flag that comes up after the read stays pending and gets its own interrupt
+    uint32_t evt = isr->handle->INT->w;
+    *(isr->handle->INTCLR) = evt & 0xff;
+    DMA_TRACE(DMA_TRACE_EVT_ISR, ch, evt & 0xff, 0);
+    
+    if(isr->handler == NULL) return;
+    
+#if DMA_USE_DEFERRED_EVENTS
+    if(isr->deferred && (DMA_eventTask != NULL) && DMA_queueEvent(ch, evt)) return;
+#endif
+    
+    DMA_isrNesting++;
+    (*(isr->handler))(evt, isr->data);
+    DMA_isrNesting--;
+}
+
+#if defined(DCH0CON) && !DMA_IS_STATIC(0)
+void __ISR(_DMA0_VECTOR) DMA0ISR(){
+    DMA_IFSCLR = _IFS1_DMA0IF_MASK << 0;
+    DMA_dispatchIRQ(0);
+}
+#endif
+
+#if defined(DCH1CON) && !DMA_IS_STATIC(1)
 void __ISR(_DMA1_VECTOR) DMA1ISR(){
     DMA_IFSCLR = _IFS1_DMA0IF_MASK << 1;
-    uint32_t evt = DMA_irqHandler[1].handle->INT->w;
-    *(DMA_irqHandler[1].handle->INTCLR) = 0xff;
-    
-    if(DMA_irqHandler[1].handler != NULL){
-        (*(DMA_irqHandler[1].handler))(evt, DMA_irqHandler[1].data);
-    }
+    DMA_dispatchIRQ(1);
 }
 #endif
 
-#ifdef DCH2CON
+#if defined(DCH2CON) && !DMA_IS_STATIC(2)
 void __ISR(_DMA2_VECTOR) DMA2ISR(){
     DMA_IFSCLR = _IFS1_DMA0IF_MASK << 2;
-    uint32_t evt = DMA_irqHandler[2].handle->INT->w;
-    *(DMA_irqHandler[2].handle->INTCLR) = 0xff;
-    
-    if(DMA_irqHandler[2].handler != NULL){
-        (*(DMA_irqHandler[2].handler))(evt, DMA_irqHandler[2].data);
-    }
+    DMA_dispatchIRQ(2);
 }
 #endif
 
-#ifdef DCH3CON
+#if defined(DCH3CON) && !DMA_IS_STATIC(3)
 void __ISR(_DMA3_VECTOR) DMA3ISR(){
     DMA_IFSCLR = _IFS1_DMA0IF_MASK << 3;
-    uint32_t evt = DMA_irqHandler[3].handle->INT->w;
-    *(DMA_irqHandler[3].handle->INTCLR) = 0xff;
-    
-    if(DMA_irqHandler[3].handler != NULL){
-        (*(DMA_irqHandler[3].handler))(evt, DMA_irqHandler[3].data);
-    }
+    DMA_dispatchIRQ(3);
 }
 #endif
 
-#ifdef DCH4CON
+#if defined(DCH4CON) && !DMA_IS_STATIC(4)
 void __ISR(_DMA4_VECTOR) DMA4ISR(){
     DMA_IFSCLR = _IFS1_DMA0IF_MASK << 4;
-    if(DMA_irqHandler[4].handler != NULL){
-        (*(DMA_irqHandler[4].handler))(DCH4INT, DMA_irqHandler[4].data);
-    }
+    DMA_dispatchIRQ(4);
 }
 #endif
 
-#ifdef DCH5CON
+#if defined(DCH5CON) && !DMA_IS_STATIC(5)
 void __ISR(_DMA5_VECTOR) DMA5ISR(){
     DMA_IFSCLR = _IFS1_DMA0IF_MASK << 5;
-    if(DMA_irqHandler[5].handler != NULL){
-        (*(DMA_irqHandler[5].handler))(DCH5INT, DMA_irqHandler[5].data);
-    }
+    DMA_dispatchIRQ(5);
 }
 #endif
 
-#ifdef DCH6CON
+#if defined(DCH6CON) && !DMA_IS_STATIC(6)
 void __ISR(_DMA6_VECTOR) DMA6ISR(){
     DMA_IFSCLR = _IFS1_DMA0IF_MASK << 6;
-    if(DMA_irqHandler[6].handler != NULL){
-        (*(DMA_irqHandler[6].handler))(DCH6INT, DMA_irqHandler[6].data);
-    }
+    DMA_dispatchIRQ(6);
 }
 #endif
 
-#ifdef DCH7CON
+#if defined(DCH7CON) && !DMA_IS_STATIC(7)
 void __ISR(_DMA7_VECTOR) DMA7ISR(){
     DMA_IFSCLR = _IFS1_DMA0IF_MASK << 7;
-    if(DMA_irqHandler[7].handler != NULL){
-        (*(DMA_irqHandler[7].handler))(DCH7INT, DMA_irqHandler[7].data);
-    }
+    DMA_dispatchIRQ(7);
 }
 #endif
\ No newline at end of file
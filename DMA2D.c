@@ -0,0 +1,170 @@
+#include <xc.h>
+#include <stdint.h>
+#include <sys/kmem.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "DMA.h"
+#include "DMA2D.h"
+#include "DMAconfig.h"
+
+static void DMA_2D_ISR(uint32_t evt, void * data);
+static void DMA_2D_armRow(DMA_2DHandle_t * handle);
+static void DMA_2D_finish(DMA_2DHandle_t * handle, uint32_t evt);
+
+DMA_2DHandle_t * DMA_create2D(uint32_t prio){
+    DMA_2DHandle_t * ret = pvPortMalloc(sizeof(DMA_2DHandle_t));
+    if(ret == NULL) return NULL;
+    
+    ret->currentRow = 0;
+    ret->transfer.height = 0;
+    ret->lastEvt = 0;
+    ret->bytesTransferred = 0;
+    ret->handler = NULL;
+    ret->handlerData = NULL;
+    
+    ret->channelHandle = DMA_allocateChannel();
+    
+    if(ret->channelHandle == NULL){
+        vPortFree(ret);
+        return NULL;
+    }
+    
+    ret->doneSemaphore = xSemaphoreCreateBinary();
+    if(ret->doneSemaphore == NULL){
+        DMA_freeChannel(ret->channelHandle);
+        vPortFree(ret);
+        return NULL;
+    }
+    
+    DMA_setIRQHandler(ret->channelHandle, DMA_2D_ISR, ret);
+    DMA_setChannelAttributes(ret->channelHandle, 0, 0, 0, 0, prio);
+    DMA_setInterruptConfig(ret->channelHandle, 0, 0, 0, 0, 1, 0, 1, 1);
+    DMA_setIRQEnabled(ret->channelHandle, 1);
+    
+    return ret;
+}
+
+void DMA_free2D(DMA_2DHandle_t * handle){
+    if(handle == NULL) return;
+    
+    DMA_freeChannel(handle->channelHandle);
+    vSemaphoreDelete(handle->doneSemaphore);
+    vPortFree(handle);
+}
+
+uint32_t DMA_2D_setCompletionHandler(DMA_2DHandle_t * handle, DMACompletionHandler_t handler, void * data){
+    handle->handler = handler;
+    handle->handlerData = data;
+    return 1;
+}
+
+//starts walking the rectangle, rows are re-armed from the block done interrupt. Completion is signalled once after the last row
+uint32_t DMA_2D_start(DMA_2DHandle_t * handle, const DMA_2DTransfer_t * transfer){
+    if(DMA_2D_isBusy(handle)) return 0;
+    if(transfer->width == 0 || transfer->height == 0 || transfer->width > DMA_MAXBLOCKSIZE) return 0;
+    
+    //triggered rows move cellSize bytes per trigger, that has to fit into a row
+    if(transfer->startIRQ != -1 && (transfer->cellSize == 0 || transfer->cellSize > transfer->width)) return 0;
+    
+    handle->transfer = *transfer;
+    DMA_2DTransfer_t * t = &handle->transfer;
+    
+    //if neither side actually has any gaps between the rows we can just move everything as one block
+    uint32_t srcLinear = (t->srcStride == t->width) || (t->srcStride == 0);
+    uint32_t dstLinear = (t->dstStride == t->width) || (t->dstStride == 0);
+    if(srcLinear && dstLinear && (t->width * t->height <= DMA_MAXBLOCKSIZE)){
+        t->width *= t->height;
+        if(t->srcStride) t->srcStride = t->width;
+        if(t->dstStride) t->dstStride = t->width;
+        t->height = 1;
+    }
+    
+    //without a trigger each row is a single forced cell. From here on cellSize is the one the channel actually uses
+    if(t->startIRQ == -1) t->cellSize = t->width;
+    
+    handle->currentRow = 0;
+    handle->lastEvt = 0;
+    handle->bytesTransferred = 0;
+    xSemaphoreTake(handle->doneSemaphore, 0);
+    
+    DMA_setTransferAttributes(handle->channelHandle, t->cellSize, t->startIRQ, -1);
+    
+    DMA_2D_armRow(handle);
+    
+    return 1;
+}
+
+//returns 1 if the whole rectangle was transferred, 0 on timeout or if the transfer was aborted
+uint32_t DMA_2D_wait(DMA_2DHandle_t * handle, uint32_t timeout){
+    if(!xSemaphoreTake(handle->doneSemaphore, timeout)) return 0;
+    return (handle->lastEvt & _DCH0INT_CHBCIF_MASK) != 0;
+}
+
+uint32_t DMA_2D_abort(DMA_2DHandle_t * handle){
+    DmaHandle_t * channel = handle->channelHandle;
+    
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    if(!DMA_2D_isBusy(handle)){
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        return 0;
+    }
+    
+    //a software abort doesn't raise CHTAIF, so finish the transfer right here. Clear the flags so a row that just completed doesn't get handled by the ISR as well
+    DMA_abortTransfer(channel);
+    DMA_clearIF(channel, 0xff);
+    
+    uint32_t bytes = DMA_getSourcePointerValue(channel);
+    if(DMA_getDestinationPointerValue(channel) > bytes) bytes = DMA_getDestinationPointerValue(channel);
+    handle->bytesTransferred += bytes;
+    handle->currentRow = handle->transfer.height;
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    DMA_2D_finish(handle, _DCH0INT_CHTAIF_MASK);
+    return 1;
+}
+
+static void DMA_2D_armRow(DMA_2DHandle_t * handle){
+    DMA_2DTransfer_t * t = &handle->transfer;
+    uint32_t row = handle->currentRow;
+    
+    //a side with stride 0 is a fixed register, that one only needs to be as large as a cell
+    DMA_setSrcConfig(handle->channelHandle, (uint32_t *) (t->src + row * t->srcStride), t->srcStride ? t->width : t->cellSize);
+    DMA_setDestConfig(handle->channelHandle, (uint32_t *) (t->dst + row * t->dstStride), t->dstStride ? t->width : t->cellSize);
+    
+    DMA_setEnabled(handle->channelHandle, 1);
+    if(t->startIRQ == -1) DMA_forceTransfer(handle->channelHandle);
+}
+
+static void DMA_2D_ISR(uint32_t evt, void * data){
+    DMA_2DHandle_t * handle = (DMA_2DHandle_t *) data;
+    
+    if(evt & _DCH0INT_CHBCIF_MASK){
+        handle->bytesTransferred += handle->transfer.width;
+        
+        //more rows left? Then just move on to the next one
+        if(++handle->currentRow < handle->transfer.height){
+            DMA_2D_armRow(handle);
+            return;
+        }
+    }else if(evt & (_DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK)){
+        handle->currentRow = handle->transfer.height;
+    }else{
+        return;
+    }
+    
+    DMA_2D_finish(handle, evt);
+}
+
+//rectangle is done (or was aborted), notify whoever is interested. Called from the ISR or from DMA_2D_abort
+static void DMA_2D_finish(DMA_2DHandle_t * handle, uint32_t evt){
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    
+    handle->lastEvt = evt;
+    if(handle->handler != NULL) handle->handler(handle->channelHandle, evt, handle->bytesTransferred, handle->handlerData);
+    
+    DMA_semaphoreGiveFromHandler(handle->doneSemaphore, &xHigherPriorityTaskWoken);
+    DMA_yieldFromHandler(xHigherPriorityTaskWoken);
+}
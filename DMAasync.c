@@ -0,0 +1,251 @@
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+#include "DMA.h"
+#include "DMAvirtual.h"
+#include "DMAasync.h"
+#include "DMAconfig.h"
+
+typedef struct{
+    DMA_VirtualRequest_t request;
+    DMA_Token_t token;
+    
+    DMACompletionHandler_t callback;
+    void * data;
+    
+    volatile uint32_t evt;
+    volatile uint32_t bytes;
+    uint32_t inUse;
+    
+    //the event group bits only wake up waiters, a bit set from the isr is applied later by the timer task and might land after the slot got reused.
+    //done is what actually says the transfer of this token finished
+    volatile uint32_t done;
+    volatile uint32_t cancelled;
+} DMA_AsyncSlot_t;
+
+static DMA_AsyncSlot_t DMA_asyncSlots[DMA_ASYNC_MAXTOKENS];
+static EventGroupHandle_t DMA_asyncEvents = NULL;
+static uint32_t DMA_asyncGeneration = 0;
+
+static void DMA_asyncComplete(DmaHandle_t * handle, uint32_t evt, uint32_t bytes, void * data);
+static void DMA_asyncSignal(uint32_t index);
+static void DMA_asyncSignalFromISR(uint32_t index);
+static EventBits_t DMA_waitDone(DMA_Token_t * tokens, uint32_t count, uint32_t waitForAll, uint32_t timeout);
+static DMA_AsyncSlot_t * DMA_getSlot(DMA_Token_t token);
+static void DMA_releaseSlot(DMA_AsyncSlot_t * slot);
+
+//tokens are (generation << 8) | (slot index + 1), so a stale token of a reused slot won't match anymore
+#define DMA_TOKEN_INDEX(token) (((token) & 0xff) - 1)
+#define DMA_TOKEN_BIT(token) (1 << DMA_TOKEN_INDEX(token))
+
+DMA_Token_t DMA_submit(void * src, uint32_t srcSize, void * dst, uint32_t dstSize, uint32_t cellSize, int32_t startIRQ, uint32_t prio, DMACompletionHandler_t callback, void * data){
+    //first call? create the event group
+    if(DMA_asyncEvents == NULL){
+        vTaskSuspendAll();
+        if(DMA_asyncEvents == NULL) DMA_asyncEvents = xEventGroupCreate();
+        xTaskResumeAll();
+        
+        if(DMA_asyncEvents == NULL) return DMA_TOKEN_INVALID;
+    }
+    
+    //find a free token slot
+    DMA_AsyncSlot_t * slot = NULL;
+    uint32_t index = 0;
+    
+    taskENTER_CRITICAL();
+    for(; index < DMA_ASYNC_MAXTOKENS; index++){
+        if(!DMA_asyncSlots[index].inUse){
+            slot = &DMA_asyncSlots[index];
+            slot->inUse = 1;
+            slot->token = (++DMA_asyncGeneration << 8) | (index + 1);
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+    
+    if(slot == NULL) return DMA_TOKEN_INVALID;
+    
+    slot->callback = callback;
+    slot->data = data;
+    slot->evt = 0;
+    slot->bytes = 0;
+    slot->done = 0;
+    slot->cancelled = 0;
+    
+    slot->request.src = src;
+    slot->request.srcSize = srcSize;
+    slot->request.dst = dst;
+    slot->request.dstSize = dstSize;
+    slot->request.cellSize = cellSize;
+    slot->request.startIRQ = startIRQ;
+    slot->request.abortIRQ = -1;
+    slot->request.prio = prio;
+    slot->request.handler = DMA_asyncComplete;
+    slot->request.data = slot;
+    slot->request.state = DMA_VC_STATE_IDLE;
+    
+    xEventGroupClearBits(DMA_asyncEvents, 1 << index);
+    
+    if(!DMA_VC_submit(&slot->request)){
+        DMA_releaseSlot(slot);
+        return DMA_TOKEN_INVALID;
+    }
+    
+    return slot->token;
+}
+
+uint32_t DMA_cancel(DMA_Token_t token){
+    DMA_AsyncSlot_t * slot = DMA_getSlot(token);
+    if(slot == NULL) return 0;
+    
+    //this either unqueues the request or aborts it, in which case the completion handler still runs (but doesn't signal the token anymore)
+    slot->cancelled = 1;
+    if(!DMA_VC_cancel(&slot->request)){
+        //the transfer is finishing right now, for a deferred channel the handler might still be running in the event task. Let it get done with the slot first
+        while(!slot->done) vTaskDelay(1);
+    }
+    
+    DMA_releaseSlot(slot);
+    
+    return 1;
+}
+
+uint32_t DMA_isDone(DMA_Token_t token){
+    DMA_AsyncSlot_t * slot = DMA_getSlot(token);
+    if(slot == NULL) return 0;
+    
+    return slot->done;
+}
+
+//returns the event flags the transfer completed with (block done, abort or error) or 0 if it timed out. The token is consumed on success
+uint32_t DMA_wait(DMA_Token_t token, uint32_t timeout, uint32_t * bytes){
+    DMA_AsyncSlot_t * slot = DMA_getSlot(token);
+    if(slot == NULL) return 0;
+    
+    if(!DMA_waitDone(&token, 1, 1, timeout)) return 0;
+    
+    uint32_t ret = slot->evt;
+    if(bytes != NULL) *bytes = slot->bytes;
+    
+    DMA_releaseSlot(slot);
+    
+    return ret;
+}
+
+//returns the index of the first token in the list that completed (that token is consumed) or -1 on timeout
+int32_t DMA_waitAny(DMA_Token_t * tokens, uint32_t count, uint32_t timeout){
+    EventBits_t bits = DMA_waitDone(tokens, count, 0, timeout);
+    if(bits == 0) return -1;
+    
+    for(uint32_t i = 0; i < count; i++){
+        if(DMA_getSlot(tokens[i]) == NULL || !(bits & DMA_TOKEN_BIT(tokens[i]))) continue;
+        
+        DMA_releaseSlot(DMA_getSlot(tokens[i]));
+        return i;
+    }
+    
+    return -1;
+}
+
+//returns 1 if all transfers completed within the timeout, then all tokens are consumed. Otherwise none of them are
+uint32_t DMA_waitAll(DMA_Token_t * tokens, uint32_t count, uint32_t timeout){
+    EventBits_t mask = 0;
+    for(uint32_t i = 0; i < count; i++){
+        if(DMA_getSlot(tokens[i]) == NULL) return 0;
+        mask |= DMA_TOKEN_BIT(tokens[i]);
+    }
+    if(mask == 0) return 1;
+    
+    if(DMA_waitDone(tokens, count, 1, timeout) != mask) return 0;
+    
+    for(uint32_t i = 0; i < count; i++) DMA_releaseSlot(DMA_getSlot(tokens[i]));
+    
+    return 1;
+}
+
+//waits until all (waitForAll) or any of the valid tokens are done and returns their bits. The event group only serves as the wakeup, so a stale bit just costs another loop
+static EventBits_t DMA_waitDone(DMA_Token_t * tokens, uint32_t count, uint32_t waitForAll, uint32_t timeout){
+    EventBits_t mask = 0;
+    for(uint32_t i = 0; i < count; i++){
+        if(DMA_getSlot(tokens[i]) != NULL) mask |= DMA_TOKEN_BIT(tokens[i]);
+    }
+    if(mask == 0) return 0;
+    
+    TimeOut_t timeOut;
+    TickType_t remaining = timeout;
+    vTaskSetTimeOutState(&timeOut);
+    
+    while(1){
+        EventBits_t done = 0;
+        for(uint32_t i = 0; i < count; i++){
+            DMA_AsyncSlot_t * slot = DMA_getSlot(tokens[i]);
+            if(slot != NULL && slot->done) done |= DMA_TOKEN_BIT(tokens[i]);
+        }
+        
+        if(waitForAll ? (done == mask) : (done != 0)) return done;
+        if(xTaskCheckForTimeOut(&timeOut, &remaining)) return done;
+        
+        //done is set before the bit, so a completion after the check above still wakes us up
+        xEventGroupWaitBits(DMA_asyncEvents, mask & ~done, pdTRUE, pdFALSE, remaining);
+    }
+}
+
+static DMA_AsyncSlot_t * DMA_getSlot(DMA_Token_t token){
+    if(token == DMA_TOKEN_INVALID) return NULL;
+    
+    uint32_t index = DMA_TOKEN_INDEX(token);
+    if(index >= DMA_ASYNC_MAXTOKENS) return NULL;
+    
+    DMA_AsyncSlot_t * slot = &DMA_asyncSlots[index];
+    if(!slot->inUse || slot->token != token) return NULL;
+    
+    return slot;
+}
+
+static void DMA_releaseSlot(DMA_AsyncSlot_t * slot){
+    if(slot == NULL) return;
+    
+    taskENTER_CRITICAL();
+    slot->token = DMA_TOKEN_INVALID;
+    slot->inUse = 0;
+    taskEXIT_CRITICAL();
+}
+
+//called by the virtual channel scheduler once the request is finished. That happens in the DMA ISR, in the event task for deferred channels or in the task calling DMA_cancel
+static void DMA_asyncComplete(DmaHandle_t * handle, uint32_t evt, uint32_t bytes, void * data){
+    DMA_AsyncSlot_t * slot = (DMA_AsyncSlot_t *) data;
+    uint32_t index = slot - DMA_asyncSlots;
+    
+    slot->evt = evt;
+    slot->bytes = bytes;
+    
+    if(slot->callback != NULL) slot->callback(handle, evt, bytes, slot->data);
+    
+    //the slot might get released and reused as soon as done is set, don't touch it after that
+    uint32_t cancelled = slot->cancelled;
+    slot->done = 1;
+    
+    //nobody waits for a cancelled token anymore
+    if(cancelled) return;
+    
+    if(DMA_inISR()){
+        DMA_asyncSignalFromISR(index);
+    }else{
+        DMA_asyncSignal(index);
+    }
+}
+
+static void DMA_asyncSignal(uint32_t index){
+    xEventGroupSetBits(DMA_asyncEvents, 1 << index);
+}
+
+static void DMA_asyncSignalFromISR(uint32_t index){
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    
+    xEventGroupSetBitsFromISR(DMA_asyncEvents, 1 << index, &xHigherPriorityTaskWoken);
+    
+    portEND_SWITCHING_ISR( xHigherPriorityTaskWoken );
+}
@@ -0,0 +1,198 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "DMAcrc.h"
+
+#ifndef DMA_CRC_SOFTWARE_ONLY
+#include <xc.h>
+#include <sys/kmem.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "DMA.h"
+#include "DMAconfig.h"
+
+static DmaHandle_t * DMA_crcOwner = NULL;
+static SemaphoreHandle_t DMA_crcDone = NULL;
+static volatile uint32_t DMA_crcEvt = 0;
+static uint32_t DMA_crcSink = 0;
+
+//the usual crc check input, coherent so the DMA sees what the cpu wrote
+static uint8_t __attribute__((coherent)) DMA_crcCheckData[9] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+static void DMA_CRC_ISR(uint32_t evt, void * data);
+#endif
+
+static uint32_t DMA_CRC_reflect(uint32_t value, uint32_t width);
+static uint32_t DMA_CRC_tableEntry(const DMA_CrcConfig_t * cfg, uint32_t index);
+
+#define DMA_CRC_MASK(width) (((width) >= 32) ? 0xffffffff : ((1UL << (width)) - 1))
+
+void DMA_CRC_initTable(const DMA_CrcConfig_t * cfg, uint32_t * table){
+    for(uint32_t i = 0; i < 256; i++) table[i] = DMA_CRC_tableEntry(cfg, i);
+}
+
+//continues a crc calculation. crc is the raw register value (seed or the result of a previous call) without the final xor applied
+uint32_t DMA_CRC_updateSW(const DMA_CrcConfig_t * cfg, uint32_t crc, const uint8_t * data, uint32_t length){
+    if(cfg->reflected){
+        //register is kept in the low bits, shifting to the right
+        while(length--){
+            uint32_t index = (crc ^ *data++) & 0xff;
+            crc = (crc >> 8) ^ ((cfg->table != NULL) ? cfg->table[index] : DMA_CRC_tableEntry(cfg, index));
+        }
+        return crc & DMA_CRC_MASK(cfg->width);
+    }else{
+        //register is left aligned, that way polynomials shorter than 8 bits work with the same table
+        crc <<= 32 - cfg->width;
+        while(length--){
+            uint32_t index = ((crc >> 24) ^ *data++) & 0xff;
+            crc = (crc << 8) ^ ((cfg->table != NULL) ? cfg->table[index] : DMA_CRC_tableEntry(cfg, index));
+        }
+        return crc >> (32 - cfg->width);
+    }
+}
+
+uint32_t DMA_CRC_computeSW(const DMA_CrcConfig_t * cfg, const uint8_t * data, uint32_t length){
+    return (DMA_CRC_updateSW(cfg, cfg->seed, data, length) ^ cfg->finalXor) & DMA_CRC_MASK(cfg->width);
+}
+
+static uint32_t DMA_CRC_tableEntry(const DMA_CrcConfig_t * cfg, uint32_t index){
+    uint32_t crc;
+    if(cfg->reflected){
+        uint32_t poly = DMA_CRC_reflect(cfg->polynomial, cfg->width);
+        crc = index;
+        for(uint32_t i = 0; i < 8; i++) crc = (crc & 1) ? ((crc >> 1) ^ poly) : (crc >> 1);
+    }else{
+        uint32_t poly = cfg->polynomial << (32 - cfg->width);
+        crc = index << 24;
+        for(uint32_t i = 0; i < 8; i++) crc = (crc & 0x80000000) ? ((crc << 1) ^ poly) : (crc << 1);
+    }
+    return crc;
+}
+
+static uint32_t DMA_CRC_reflect(uint32_t value, uint32_t width){
+    uint32_t ret = 0;
+    for(uint32_t i = 0; i < width; i++){
+        ret = (ret << 1) | (value & 1);
+        value >>= 1;
+    }
+    return ret;
+}
+
+#ifdef DMA_CRC_SOFTWARE_ONLY
+
+uint32_t DMA_CRC_compute(const DMA_CrcConfig_t * cfg, const uint8_t * data, uint32_t length, uint32_t timeout, uint32_t * result){
+    (void)timeout;
+    *result = DMA_CRC_computeSW(cfg, data, length);
+    return 1;
+}
+
+#else
+
+uint32_t DMA_CRC_attach(DmaHandle_t * handle, const DMA_CrcConfig_t * cfg, uint32_t mode){
+    if(cfg->width == 0 || cfg->width > 32) return 0;
+    
+    //engine already in use by someone else?
+    taskENTER_CRITICAL();
+    if(DMA_crcOwner != NULL && DMA_crcOwner != handle){
+        taskEXIT_CRITICAL();
+        return 0;
+    }
+    DMA_crcOwner = handle;
+    taskEXIT_CRITICAL();
+    
+    uint32_t temp = (handle->moduleID << _DCRCCON_CRCCH_POSITION) & _DCRCCON_CRCCH_MASK;
+    temp |= ((cfg->width - 1) << _DCRCCON_PLEN_POSITION) & _DCRCCON_PLEN_MASK;
+    if(mode == DMA_CRC_MODE_APPEND) temp |= _DCRCCON_CRCAPP_MASK;
+#ifdef _DCRCCON_BITO_MASK
+    if(cfg->reflected) temp |= _DCRCCON_BITO_MASK;
+#endif
+    
+    //engine must be off while the polynomial and seed are changed
+    DCRCCON = 0;
+    DCRCXOR = cfg->polynomial;
+    DCRCDATA = cfg->seed;
+    DCRCCON = temp | _DCRCCON_CRCEN_MASK;
+    
+    return 1;
+}
+
+uint32_t DMA_CRC_detach(DmaHandle_t * handle){
+    if(DMA_crcOwner != handle) return 0;
+    
+    DCRCCONCLR = _DCRCCON_CRCEN_MASK;
+    DMA_crcOwner = NULL;
+    
+    return 1;
+}
+
+uint32_t DMA_CRC_getResult(const DMA_CrcConfig_t * cfg){
+    return (DCRCDATA ^ cfg->finalXor) & DMA_CRC_MASK(cfg->width);
+}
+
+uint32_t DMA_CRC_compute(const DMA_CrcConfig_t * cfg, const uint8_t * data, uint32_t length, uint32_t timeout, uint32_t * result){
+    DmaHandle_t * handle = DMA_allocateChannel();
+    if(handle == NULL) return 0;
+    
+    if(!DMA_CRC_attach(handle, cfg, DMA_CRC_MODE_APPEND)){
+        DMA_freeChannel(handle);
+        return 0;
+    }
+    
+    //only whoever owns the crc engine gets here, so no need to worry about two tasks creating the semaphore
+    if(DMA_crcDone == NULL) DMA_crcDone = xSemaphoreCreateBinary();
+    xSemaphoreTake(DMA_crcDone, 0);
+    
+    DMA_setIRQHandler(handle, DMA_CRC_ISR, NULL);
+    DMA_setChannelAttributes(handle, 0, 0, 0, 0, 0);
+    DMA_setInterruptConfig(handle, 0, 0, 0, 0, 1, 0, 1, 1);
+    DMA_setIRQEnabled(handle, 1);
+    
+    //in append mode the destination only receives the crc once the block is done. The engine keeps its state between blocks, so longer buffers are just fed in pieces
+    uint32_t ret = 1;
+    while(length > 0 && ret){
+        uint32_t block = (length > DMA_MAXBLOCKSIZE) ? DMA_MAXBLOCKSIZE : length;
+        
+        DMA_setSrcConfig(handle, (uint32_t *) data, block);
+        DMA_setDestConfig(handle, &DMA_crcSink, sizeof(DMA_crcSink));
+        DMA_setTransferAttributes(handle, block, -1, -1);
+        
+        DMA_crcEvt = 0;
+        DMA_setEnabled(handle, 1);
+        DMA_forceTransfer(handle);
+        
+        ret = xSemaphoreTake(DMA_crcDone, timeout) && (DMA_crcEvt & _DCH0INT_CHBCIF_MASK);
+        
+        data += block;
+        length -= block;
+    }
+    
+    if(ret) *result = DMA_CRC_getResult(cfg);
+    
+    DMA_CRC_detach(handle);
+    DMA_freeChannel(handle);
+    
+    return ret;
+}
+
+//runs the check input through the engine and through the software implementation. Returns 1 if the engine gives the same result for this configuration
+uint32_t DMA_CRC_verify(const DMA_CrcConfig_t * cfg, uint32_t timeout){
+    uint32_t hw = 0;
+    if(!DMA_CRC_compute(cfg, DMA_crcCheckData, sizeof(DMA_crcCheckData), timeout, &hw)) return 0;
+    
+    return hw == DMA_CRC_computeSW(cfg, DMA_crcCheckData, sizeof(DMA_crcCheckData));
+}
+
+static void DMA_CRC_ISR(uint32_t evt, void * data){
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    
+    if(!(evt & (_DCH0INT_CHBCIF_MASK | _DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK))) return;
+    
+    DMA_crcEvt = evt;
+    DMA_semaphoreGiveFromHandler(DMA_crcDone, &xHigherPriorityTaskWoken);
+    
+    DMA_yieldFromHandler(xHigherPriorityTaskWoken);
+}
+
+#endif
@@ -0,0 +1,320 @@
+#include <xc.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/kmem.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "DMA.h"
+#include "DMAduplex.h"
+#include "DMAconfig.h"
+#include "System.h"
+
+static void DMA_DPX_rxISR(uint32_t evt, void * data);
+static void DMA_DPX_txISR(uint32_t evt, void * data);
+static void DMA_DPX_start(DMA_DuplexHandle_t * handle);
+static void DMA_DPX_armChunk(DMA_DuplexHandle_t * handle);
+static void DMA_DPX_finish(DMA_DuplexHandle_t * handle, uint32_t evt);
+
+DMA_DuplexHandle_t * DMA_createDuplex(volatile void * txReg, volatile void * rxReg, uint32_t cellSize, uint32_t txIRQ, uint32_t rxIRQ, uint32_t prio){
+    DMA_DuplexHandle_t * ret = pvPortMalloc(sizeof(DMA_DuplexHandle_t));
+    if(ret == NULL) return NULL;
+    
+    DmaHandle_t * txChannel = DMA_allocateChannel();
+    DmaHandle_t * rxChannel = DMA_allocateChannel();
+    
+    if(txChannel == NULL || rxChannel == NULL || !DMA_DPX_init(ret, txChannel, rxChannel, txReg, rxReg, cellSize, txIRQ, rxIRQ, prio)){
+        if(txChannel != NULL) DMA_freeChannel(txChannel);
+        if(rxChannel != NULL) DMA_freeChannel(rxChannel);
+        vPortFree(ret);
+        return NULL;
+    }
+    
+    ret->ownsChannels = 1;
+    
+    return ret;
+}
+
+//sets up a duplex handle on two channels the caller already owns (e.g. statically assigned ones). txIRQ/rxIRQ are the peripheral's transmit buffer empty and receive buffer full interrupts
+uint32_t DMA_DPX_init(DMA_DuplexHandle_t * handle, DmaHandle_t * txChannel, DmaHandle_t * rxChannel, volatile void * txReg, volatile void * rxReg, uint32_t cellSize, uint32_t txIRQ, uint32_t rxIRQ, uint32_t prio){
+    if(cellSize == 0 || cellSize > 4 || (DMA_DUPLEX_SCRATCHSIZE % cellSize) != 0) return 0;
+    
+    handle->txChannel = txChannel;
+    handle->rxChannel = rxChannel;
+    handle->txReg = txReg;
+    handle->rxReg = rxReg;
+    handle->cellSize = cellSize;
+    
+    handle->current = NULL;
+    handle->queueHead = NULL;
+    handle->queueTail = NULL;
+    handle->position = 0;
+    handle->chunk = 0;
+    handle->fillWord = 0;
+    handle->ownsChannels = 0;
+    
+    uint8_t * scratch = pvPortMalloc(2 * DMA_DUPLEX_SCRATCHSIZE);
+    if(scratch == NULL) return 0;
+    
+    handle->doneSemaphore = xSemaphoreCreateBinary();
+    if(handle->doneSemaphore == NULL){
+        vPortFree(scratch);
+        return 0;
+    }
+    
+    handle->fill = SYS_makeCoherent(scratch);
+    handle->discard = handle->fill + DMA_DUPLEX_SCRATCHSIZE;
+    memset(handle->fill, 0, DMA_DUPLEX_SCRATCHSIZE);
+    
+    //rx completes the transaction, so only that one needs the block done interrupt. tx only reports problems
+    DMA_setIRQHandler(rxChannel, DMA_DPX_rxISR, handle);
+    DMA_setChannelAttributes(rxChannel, 0, 0, 0, 0, prio);
+    DMA_setInterruptConfig(rxChannel, 0, 0, 0, 0, 1, 0, 1, 1);
+    DMA_setTransferAttributes(rxChannel, cellSize, rxIRQ, -1);
+    DMA_setIRQEnabled(rxChannel, 1);
+    
+    DMA_setIRQHandler(txChannel, DMA_DPX_txISR, handle);
+    DMA_setChannelAttributes(txChannel, 0, 0, 0, 0, prio);
+    DMA_setInterruptConfig(txChannel, 0, 0, 0, 0, 0, 0, 1, 1);
+    DMA_setTransferAttributes(txChannel, cellSize, txIRQ, -1);
+    DMA_setIRQEnabled(txChannel, 1);
+    
+    return 1;
+}
+
+void DMA_freeDuplex(DMA_DuplexHandle_t * handle){
+    if(handle == NULL) return;
+    
+    DMA_DPX_abort(handle);
+    
+    if(handle->ownsChannels){
+        DMA_freeChannel(handle->txChannel);
+        DMA_freeChannel(handle->rxChannel);
+    }else{
+        //channels stay with the caller, just without our handlers
+        DMA_setIRQHandler(handle->txChannel, NULL, NULL);
+        DMA_setIRQHandler(handle->rxChannel, NULL, NULL);
+    }
+    
+    vSemaphoreDelete(handle->doneSemaphore);
+    vPortFree(SYS_makeNonCoherent(handle->fill));
+    
+    //a handle set up with DMA_DPX_init belongs to the caller as well
+    if(handle->ownsChannels) vPortFree(handle);
+}
+
+//queues a transaction, or a list of them linked through next. The first one starts right away if nothing else is running
+uint32_t DMA_DPX_submit(DMA_DuplexHandle_t * handle, DMA_DuplexTransaction_t * transactions){
+    if(transactions == NULL) return 0;
+    
+    //check the whole list before touching the queue
+    DMA_DuplexTransaction_t * last = transactions;
+    for(DMA_DuplexTransaction_t * curr = transactions; curr != NULL; curr = curr->next){
+        if(curr->length == 0 || (curr->length % handle->cellSize) != 0) return 0;
+        if(curr->state == DMA_DPX_STATE_QUEUED || curr->state == DMA_DPX_STATE_ACTIVE) return 0;
+        last = curr;
+    }
+    
+    for(DMA_DuplexTransaction_t * curr = transactions; curr != NULL; curr = curr->next){
+        curr->state = DMA_DPX_STATE_QUEUED;
+        curr->lastEvt = 0;
+        curr->bytesTransferred = 0;
+    }
+    
+    taskENTER_CRITICAL();
+    
+    if(handle->queueTail != NULL){
+        handle->queueTail->next = transactions;
+    }else{
+        handle->queueHead = transactions;
+    }
+    handle->queueTail = last;
+    
+    if(handle->current == NULL){
+        //going from idle to busy, forget the completion of the last batch
+        xSemaphoreTake(handle->doneSemaphore, 0);
+        DMA_DPX_start(handle);
+    }
+    
+    taskEXIT_CRITICAL();
+    
+    return 1;
+}
+
+//waits until everything that was submitted is done. Returns 0 on timeout
+uint32_t DMA_DPX_wait(DMA_DuplexHandle_t * handle, uint32_t timeout){
+    if(handle->current == NULL) return 1;
+    return xSemaphoreTake(handle->doneSemaphore, timeout) == pdTRUE;
+}
+
+//stops the running transaction and drops the queue. All of them complete with the abort flag set
+uint32_t DMA_DPX_abort(DMA_DuplexHandle_t * handle){
+    taskENTER_CRITICAL();
+    
+    if(handle->current == NULL){
+        taskEXIT_CRITICAL();
+        return 0;
+    }
+    
+    //stop rx first so it doesn't wait for data that is never going to come. The flags get cleared right away so the isrs don't see the abort
+    DMA_abortTransfer(handle->rxChannel);
+    DMA_abortTransfer(handle->txChannel);
+    DMA_clearIF(handle->rxChannel, 0xff);
+    DMA_clearIF(handle->txChannel, 0xff);
+    
+    //record the end of the current transaction and take the queue off the handle, nothing gets started anymore
+    DMA_DuplexTransaction_t * current = handle->current;
+    current->bytesTransferred = handle->position;
+    current->lastEvt = _DCH0INT_CHTAIF_MASK;
+    current->state = DMA_DPX_STATE_DONE;
+    handle->current = NULL;
+    
+    DMA_DuplexTransaction_t * queued = handle->queueHead;
+    handle->queueHead = NULL;
+    handle->queueTail = NULL;
+    
+    taskEXIT_CRITICAL();
+    
+    //none of the transactions are referenced by the handle anymore, so their handlers can run in task context outside the critical section
+    if(current->handler != NULL) current->handler(handle->rxChannel, _DCH0INT_CHTAIF_MASK, current->bytesTransferred, current->data);
+    
+    while(queued != NULL){
+        DMA_DuplexTransaction_t * next = queued->next;
+        queued->lastEvt = _DCH0INT_CHTAIF_MASK;
+        queued->state = DMA_DPX_STATE_DONE;
+        if(queued->handler != NULL) queued->handler(handle->rxChannel, _DCH0INT_CHTAIF_MASK, 0, queued->data);
+        queued = next;
+    }
+    
+    xSemaphoreGive(handle->doneSemaphore);
+    
+    return 1;
+}
+
+//blocking single transaction. Returns 1 if all bytes were exchanged
+uint32_t DMA_DPX_transfer(DMA_DuplexHandle_t * handle, const uint8_t * txData, uint8_t * rxData, uint32_t length, uint32_t timeout){
+    DMA_DuplexTransaction_t transaction = {
+        .next = NULL,
+        .txData = txData,
+        .rxData = rxData,
+        .length = length,
+        .txFill = 0xffffffff,
+        .handler = NULL,
+        .data = NULL,
+        .state = DMA_DPX_STATE_IDLE
+    };
+    
+    if(!DMA_DPX_submit(handle, &transaction)) return 0;
+    
+    //the transaction lives on our stack, so it must not stay queued if we give up waiting
+    while(!DMA_DPX_isDone(&transaction)){
+        if(!DMA_DPX_wait(handle, timeout)){
+            DMA_DPX_abort(handle);
+            return 0;
+        }
+    }
+    
+    return DMA_DPX_succeeded(&transaction);
+}
+
+//takes the next transaction off the queue and starts it. Called with interrupts disabled or from the isr
+static void DMA_DPX_start(DMA_DuplexHandle_t * handle){
+    DMA_DuplexTransaction_t * transaction = handle->queueHead;
+    
+    if(transaction == NULL){
+        handle->current = NULL;
+        return;
+    }
+    
+    handle->queueHead = transaction->next;
+    if(handle->queueHead == NULL) handle->queueTail = NULL;
+    
+    //spread the fill word over the scratch buffer if it changed
+    if(transaction->txData == NULL && transaction->txFill != handle->fillWord){
+        handle->fillWord = transaction->txFill;
+        for(uint32_t i = 0; i < DMA_DUPLEX_SCRATCHSIZE; i += handle->cellSize) memcpy(&handle->fill[i], &handle->fillWord, handle->cellSize);
+    }
+    
+    transaction->state = DMA_DPX_STATE_ACTIVE;
+    handle->current = transaction;
+    handle->position = 0;
+    
+    DMA_DPX_armChunk(handle);
+}
+
+//both channels always move the same chunk, so once rx is done with it tx is idle as well and both can be rearmed together
+static void DMA_DPX_armChunk(DMA_DuplexHandle_t * handle){
+    DMA_DuplexTransaction_t * transaction = handle->current;
+    uint32_t offset = handle->position;
+    
+    uint32_t chunk = transaction->length - offset;
+    if(chunk > DMA_MAXBLOCKSIZE) chunk = DMA_MAXBLOCKSIZE - (DMA_MAXBLOCKSIZE % handle->cellSize);
+    if((transaction->txData == NULL || transaction->rxData == NULL) && chunk > DMA_DUPLEX_SCRATCHSIZE) chunk = DMA_DUPLEX_SCRATCHSIZE;
+    handle->chunk = chunk;
+    
+    //rx has to be ready before the first cell goes out, otherwise we might miss the first received word
+    DMA_setSrcConfig(handle->rxChannel, (uint32_t *) handle->rxReg, handle->cellSize);
+    DMA_setDestConfig(handle->rxChannel, (uint32_t *) ((transaction->rxData != NULL) ? &transaction->rxData[offset] : handle->discard), chunk);
+    DMA_setEnabled(handle->rxChannel, 1);
+    
+    DMA_setSrcConfig(handle->txChannel, (uint32_t *) ((transaction->txData != NULL) ? &transaction->txData[offset] : handle->fill), chunk);
+    DMA_setDestConfig(handle->txChannel, (uint32_t *) handle->txReg, handle->cellSize);
+    DMA_setEnabled(handle->txChannel, 1);
+    
+    //the transmit buffer is already empty, so its interrupt won't come for the first cell
+    DMA_forceTransfer(handle->txChannel);
+}
+
+//completes the current transaction and moves on to the next one. Called with interrupts disabled or from the isr
+static void DMA_DPX_finish(DMA_DuplexHandle_t * handle, uint32_t evt){
+    DMA_DuplexTransaction_t * transaction = handle->current;
+    if(transaction == NULL) return;
+    
+    transaction->bytesTransferred = handle->position;
+    transaction->lastEvt = evt;
+    transaction->state = DMA_DPX_STATE_DONE;
+    if(transaction->handler != NULL) transaction->handler(handle->rxChannel, evt, handle->position, transaction->data);
+    
+    DMA_DPX_start(handle);
+    
+    //only wake up the waiting task once the whole batch is through
+    if(handle->current == NULL){
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        DMA_semaphoreGiveFromHandler(handle->doneSemaphore, &xHigherPriorityTaskWoken);
+        DMA_yieldFromHandler(xHigherPriorityTaskWoken);
+    }
+}
+
+static void DMA_DPX_rxISR(uint32_t evt, void * data){
+    DMA_DuplexHandle_t * handle = (DMA_DuplexHandle_t *) data;
+    if(handle->current == NULL) return;
+    
+    if(evt & (_DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK)){
+        //rx broke down, tx would just run into the void
+        DMA_abortTransfer(handle->txChannel);
+        DMA_clearIF(handle->txChannel, 0xff);
+        DMA_DPX_finish(handle, evt);
+    }else if(evt & _DCH0INT_CHBCIF_MASK){
+        handle->position += handle->chunk;
+    
+        if(handle->position < handle->current->length){
+            DMA_DPX_armChunk(handle);
+            return;
+        }
+    
+        DMA_DPX_finish(handle, evt);
+    }
+}
+
+static void DMA_DPX_txISR(uint32_t evt, void * data){
+    DMA_DuplexHandle_t * handle = (DMA_DuplexHandle_t *) data;
+    if(handle->current == NULL) return;
+    
+    if(evt & (_DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK)){
+        //nothing is going to be clocked in anymore either, stop rx without letting it raise its own abort
+        DMA_abortTransfer(handle->rxChannel);
+        DMA_clearIF(handle->rxChannel, 0xff);
+        DMA_DPX_finish(handle, evt);
+    }
+}
@@ -0,0 +1,228 @@
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "DMA.h"
+#include "DMAutils.h"
+#include "DMAprio.h"
+#include "DMAconfig.h"
+
+typedef struct{
+    DmaHandle_t * channel;
+    DMA_RingBufferHandle_t * ring;
+    
+    uint32_t prioClass;
+    uint32_t highWater;
+    uint32_t lowWater;
+    
+    //throughput the stream needs in bytes per second (0 = none declared) and what the channel moved up to the last update
+    uint32_t rate;
+    uint32_t lastTotal;
+    TickType_t lastTick;
+    uint32_t hadWork;
+    
+    uint32_t boosted;
+    uint32_t boostCount;
+    uint32_t holdLeft;
+    uint32_t currentPrio;
+} DMA_PrioEntry_t;
+
+//one entry per hardware channel, indexed by the channel number
+static DMA_PrioEntry_t DMA_prioEntries[DMA_CHANNELCOUNT];
+static TaskHandle_t DMA_prioTask = NULL;
+static uint32_t DMA_prioPeriod = 1;
+
+static void DMA_PRIO_taskFunction(void * params);
+static void DMA_PRIO_updateBoost(DMA_PrioEntry_t * entry);
+static uint32_t DMA_PRIO_getBacklog(DMA_PrioEntry_t * entry);
+static uint32_t DMA_PRIO_isStarved(DMA_PrioEntry_t * entry, uint32_t hasWork);
+static void DMA_PRIO_resetRate(DMA_PrioEntry_t * entry);
+static void DMA_PRIO_apply(DMA_PrioEntry_t * entry, uint32_t prio);
+
+//puts a channel under the control of the priority manager. Only channels with a ring can get boosted, see DMA_PRIO_updateBoost for when
+//channels must be unregistered before they (or their ring) are freed
+uint32_t DMA_PRIO_register(DmaHandle_t * channel, uint32_t prioClass, DMA_RingBufferHandle_t * ring){
+    if(channel == NULL || prioClass > DMA_PRIO_CLASS_LATENCY) return 0;
+    
+    DMA_PrioEntry_t * entry = &DMA_prioEntries[channel->moduleID];
+    uint32_t total = (ring != NULL) ? DMA_RB_getTransferTotal(ring) : 0;
+    
+    taskENTER_CRITICAL();
+    entry->ring = ring;
+    entry->prioClass = prioClass;
+    entry->highWater = DMA_PRIO_DEFAULT_HIGHWATER;
+    entry->lowWater = DMA_PRIO_DEFAULT_LOWWATER;
+    entry->rate = 0;
+    entry->lastTotal = total;
+    entry->lastTick = xTaskGetTickCount();
+    entry->hadWork = 0;
+    entry->boosted = 0;
+    entry->boostCount = 0;
+    entry->holdLeft = 0;
+    entry->currentPrio = DMA_PRIO_BOOST + 1;  //makes sure the first apply actually writes the register
+    entry->channel = channel;
+    taskEXIT_CRITICAL();
+    
+    DMA_PRIO_apply(entry, prioClass);
+    
+    return 1;
+}
+
+uint32_t DMA_PRIO_registerRing(DMA_RingBufferHandle_t * ring, uint32_t prioClass){
+    return DMA_PRIO_register(ring->channelHandle, prioClass, ring);
+}
+
+//the channel keeps whatever priority it has right now
+uint32_t DMA_PRIO_unregister(DmaHandle_t * channel){
+    DMA_PrioEntry_t * entry = &DMA_prioEntries[channel->moduleID];
+    if(entry->channel != channel) return 0;
+    
+    taskENTER_CRITICAL();
+    entry->channel = NULL;
+    entry->ring = NULL;
+    taskEXIT_CRITICAL();
+    
+    return 1;
+}
+
+uint32_t DMA_PRIO_setWatermarks(DmaHandle_t * channel, uint32_t highPercent, uint32_t lowPercent){
+    DMA_PrioEntry_t * entry = &DMA_prioEntries[channel->moduleID];
+    if(entry->channel != channel || highPercent > 100 || lowPercent >= highPercent) return 0;
+    
+    entry->highWater = highPercent;
+    entry->lowWater = lowPercent;
+    
+    return 1;
+}
+
+//throughput (bytes per second) the channel must keep up so the peripheral doesn't overrun (RX) or run dry (TX). Once the channel moves
+//less than that while it has work to do it gets boosted. 0 turns it off again. Only works for channels registered with their ring.
+//Meant for streams that deliver continuously, an RX peripheral that goes quiet looks just like a channel that can't keep up
+uint32_t DMA_PRIO_setRate(DmaHandle_t * channel, uint32_t bytesPerSecond){
+    DMA_PrioEntry_t * entry = &DMA_prioEntries[channel->moduleID];
+    if(entry->channel != channel || entry->ring == NULL) return 0;
+    
+    vTaskSuspendAll();
+    entry->rate = bytesPerSecond;
+    DMA_PRIO_resetRate(entry);
+    xTaskResumeAll();
+    
+    return 1;
+}
+
+uint32_t DMA_PRIO_isBoosted(DmaHandle_t * channel){
+    DMA_PrioEntry_t * entry = &DMA_prioEntries[channel->moduleID];
+    return (entry->channel == channel) && entry->boosted;
+}
+
+uint32_t DMA_PRIO_getBoostCount(DmaHandle_t * channel){
+    DMA_PrioEntry_t * entry = &DMA_prioEntries[channel->moduleID];
+    return (entry->channel == channel) ? entry->boostCount : 0;
+}
+
+//re-evaluates all registered channels. Call this periodically (or let DMA_PRIO_startTask do it), the period needs to be shorter than the time it
+//takes a TX ring to run dry from the high watermark or the peripheral of an RX ring to overrun
+void DMA_PRIO_update(){
+    //keeps other tasks from unregistering (and freeing) anything while we're looking at it
+    vTaskSuspendAll();
+    
+    for(uint32_t ch = 0; ch < DMA_CHANNELCOUNT; ch++){
+        DMA_PrioEntry_t * entry = &DMA_prioEntries[ch];
+        if(entry->channel == NULL) continue;
+        
+        if(entry->ring != NULL) DMA_PRIO_updateBoost(entry);
+        
+        DMA_PRIO_apply(entry, entry->boosted ? DMA_PRIO_BOOST : entry->prioClass);
+    }
+    
+    xTaskResumeAll();
+}
+
+//a higher CHPRI only makes the channel itself faster, so the boost goes by what the channel does and not by how far the consumer is behind:
+//  - any ring with a declared rate that moved less than that since the last update while it had work (RX: channel running, TX: data queued)
+//  - a TX ring whose queued data crosses the high watermark. It stays boosted until it's down to the low one, so we don't flip every update
+//the fill level of an RX ring says nothing here, the channel writes into it at whatever rate the peripheral delivers no matter how full it is.
+//A rate boost is held for DMA_PRIO_BOOST_HOLD updates after the channel last fell behind, a boosted channel that keeps up would drop back otherwise
+static void DMA_PRIO_updateBoost(DMA_PrioEntry_t * entry){
+    uint32_t tx = (entry->ring->direction == RINGBUFFER_DIRECTION_TX);
+    uint32_t backlog = tx ? DMA_PRIO_getBacklog(entry) : 0;
+    
+    //a stopped RX ring isn't going to overrun and an empty TX ring has nothing to send
+    uint32_t hasWork = tx ? (backlog > 0 || DMA_isEnabled(entry->channel)) : DMA_isEnabled(entry->channel);
+    
+    uint32_t starved = DMA_PRIO_isStarved(entry, hasWork);
+    uint32_t backedUp = tx && (backlog >= entry->highWater);
+    
+    if(starved || backedUp){
+        if(!entry->boosted) entry->boostCount++;
+        entry->boosted = 1;
+        if(starved) entry->holdLeft = DMA_PRIO_BOOST_HOLD;
+    }else if(entry->boosted){
+        if(entry->holdLeft > 0) entry->holdLeft--;
+        if(!hasWork || (entry->holdLeft == 0 && backlog <= entry->lowWater)){
+            entry->boosted = 0;
+            entry->holdLeft = 0;
+        }
+    }
+}
+
+//whether the channel moved less than the declared rate since the last update even though it had work for all of it
+static uint32_t DMA_PRIO_isStarved(DMA_PrioEntry_t * entry, uint32_t hasWork){
+    TickType_t now = xTaskGetTickCount();
+    TickType_t elapsed = now - entry->lastTick;
+    if(elapsed == 0) return 0;
+    
+    uint32_t total = DMA_RB_getTransferTotal(entry->ring);
+    uint32_t moved = total - entry->lastTotal;
+    uint32_t busy = entry->hadWork && hasWork;
+    
+    entry->lastTotal = total;
+    entry->lastTick = now;
+    entry->hadWork = hasWork;
+    
+    if(entry->rate == 0 || !busy) return 0;
+    return ((uint64_t) moved * configTICK_RATE_HZ) < ((uint64_t) entry->rate * elapsed);
+}
+
+static void DMA_PRIO_resetRate(DMA_PrioEntry_t * entry){
+    entry->lastTotal = DMA_RB_getTransferTotal(entry->ring);
+    entry->lastTick = xTaskGetTickCount();
+    entry->hadWork = 0;
+}
+
+uint32_t DMA_PRIO_startTask(uint32_t priority, uint32_t period){
+    DMA_prioPeriod = (period == 0) ? 1 : period;
+    
+    if(DMA_prioTask != NULL){
+        vTaskPrioritySet(DMA_prioTask, priority);
+        return 1;
+    }
+    
+    return xTaskCreate(DMA_PRIO_taskFunction, "DMAprio", DMA_PRIO_TASK_STACKSIZE, NULL, priority, &DMA_prioTask) == pdPASS;
+}
+
+static void DMA_PRIO_taskFunction(void * params){
+    while(1){
+        DMA_PRIO_update();
+        vTaskDelay(DMA_prioPeriod);
+    }
+}
+
+//data queued in a TX ring that the channel didn't send yet, in percent of the ring
+static uint32_t DMA_PRIO_getBacklog(DMA_PrioEntry_t * entry){
+    DMA_RingBufferHandle_t * ring = entry->ring;
+    
+    uint32_t used = DMA_RB_available(ring);
+    if(used > ring->bufferSize) used = ring->bufferSize;
+    
+    return (used * 100) / ring->bufferSize;
+}
+
+static void DMA_PRIO_apply(DMA_PrioEntry_t * entry, uint32_t prio){
+    if(entry->currentPrio == prio) return;
+    entry->currentPrio = prio;
+    
+    //the channel is most likely running, so only CHPRI may change
+    DMA_setPriority(entry->channel, prio);
+}
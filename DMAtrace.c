@@ -0,0 +1,46 @@
+#include <xc.h>
+#include <stdint.h>
+
+#include "DMAtrace.h"
+#include "DMAconfig.h"
+
+#if DMA_USE_TRACE
+
+DMA_TraceRecord_t DMA_traceBuffer[DMA_TRACE_SIZE];
+volatile uint32_t DMA_traceIndex = 0;
+volatile uint32_t DMA_traceEnabled = 1;
+
+void DMA_traceSetEnabled(uint32_t enabled){
+    DMA_traceEnabled = enabled;
+}
+
+void DMA_traceClear(){
+    DMA_traceIndex = 0;
+}
+
+//writes header and records (oldest first) through the callback. Recording is paused while dumping so the buffer doesn't change underneath us
+uint32_t DMA_traceDump(void (* write)(const void * data, uint32_t length, void * ctx), void * ctx){
+    uint32_t wasEnabled = DMA_traceEnabled;
+    DMA_traceEnabled = 0;
+    
+    uint32_t end = DMA_traceIndex;
+    uint32_t count = (end > DMA_TRACE_SIZE) ? DMA_TRACE_SIZE : end;
+    
+    DMA_TraceHeader_t header = {
+        .magic = DMA_TRACE_MAGIC,
+        .version = DMA_TRACE_VERSION,
+        .timerFrequency = DMA_TRACE_TIMER_FREQ,
+        .recordCount = count
+    };
+    write(&header, sizeof(header), ctx);
+    
+    for(uint32_t i = end - count; i != end; i++){
+        write(&DMA_traceBuffer[i & (DMA_TRACE_SIZE - 1)], sizeof(DMA_TraceRecord_t), ctx);
+    }
+    
+    DMA_traceEnabled = wasEnabled;
+    
+    return count;
+}
+
+#endif
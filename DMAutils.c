@@ -5,61 +5,133 @@
 
 #include "DMA.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 #include "stream_buffer.h"
 #include "DMAutils.h"
 #include "DMAconfig.h"
+#include "DMAtrace.h"
+#if DMA_USE_ASYNC
+#include "DMAasync.h"
+#endif
 #include "System.h"
 
 
-static void DMA_RB_ISR(uint32_t evt, void * data);
+static inline uint32_t DMA_RB_getWritePos(DMA_RingBufferHandle_t * handle);
+static void DMA_RB_rearmAt(DMA_RingBufferHandle_t * handle, uint32_t pos, uint32_t enable);
+static void DMA_RB_txArm(DMA_RingBufferHandle_t * handle, uint32_t force);
+static uint32_t DMA_RB_halt(DMA_RingBufferHandle_t * handle);
+static uint32_t DMA_RB_getWriteTotal(DMA_RingBufferHandle_t * handle);
+static uint32_t DMA_RB_totalToIndex(DMA_RingBufferHandle_t * handle, uint32_t total);
+static void DMA_RB_restartStream(DMA_RingBufferHandle_t * handle);
+static uint32_t DMA_RB_commitRead(DMA_RingBufferHandle_t * handle, uint32_t aborts, uint32_t readPos);
+static void DMA_RB_cellIRQRef(DMA_RingBufferHandle_t * handle, int32_t ref);
+static void DMA_RB_updateRate(DMA_RingBufferHandle_t * handle);
+static inline void DMA_RB_notify(DMA_RingBufferHandle_t * handle, BaseType_t * woken);
+static uint32_t DMA_RB_selectNotifyMode(DMA_RingBufferHandle_t * handle);
+static void DMA_RB_setNotifyIRQ(DMA_RingBufferHandle_t * handle, uint32_t mode, int32_t enabled);
+static void DMA_RB_updateTracking(DMA_RingBufferHandle_t * handle);
+static uint32_t DMA_RB_abortPos(DMA_RingBufferHandle_t * handle, uint32_t evt, uint32_t * unknown);
 
 DMA_RingBufferHandle_t * DMA_createRingBuffer(uint32_t bufferSize, uint32_t dataSize, uint32_t * dataSrc, uint32_t dataReadyInt, uint32_t prio, uint32_t direction){
+    if(direction != RINGBUFFER_DIRECTION_RX && direction != RINGBUFFER_DIRECTION_TX) return NULL;
+    
     DMA_RingBufferHandle_t * ret = pvPortMalloc(sizeof(DMA_RingBufferHandle_t));
+    if(ret == NULL) return NULL;
+    
+    DmaHandle_t * channelHandle = DMA_allocateChannel();
+    if(channelHandle == NULL){
+        vPortFree(ret);
+        return NULL;
+    }
+    
+    uint8_t * data = SYS_makeCoherent(pvPortMalloc(bufferSize));
+    
+    if(!DMA_RB_init(ret, channelHandle, data, bufferSize, dataSize, dataSrc, dataReadyInt, prio, direction)){
+        DMA_freeChannel(channelHandle);
+        vPortFree(SYS_makeNonCoherent(data));
+        vPortFree(ret);
+        return NULL;
+    }
+    
+    return ret;
+}
+
+//sets up a ring buffer in memory owned by the caller on an already claimed channel. Used by DMA_createRingBuffer and for statically assigned channels (DMAstatic.h)
+//data must be coherent (uncached) memory of bufferSize bytes
+uint32_t DMA_RB_init(DMA_RingBufferHandle_t * ret, DmaHandle_t * channelHandle, uint8_t * data, uint32_t bufferSize, uint32_t dataSize, uint32_t * dataSrc, uint32_t dataReadyInt, uint32_t prio, uint32_t direction){
+    if(direction != RINGBUFFER_DIRECTION_RX && direction != RINGBUFFER_DIRECTION_TX) return 0;
     
     ret->direction = direction;
     ret->lastReadPos = 0;
     ret->bufferSize = bufferSize;
     ret->dataSize = dataSize;
     ret->dataReadyInt = dataReadyInt;
+    ret->restartOnError = 0;
     
-    ret->channelHandle = DMA_allocateChannel();
+    ret->recoveryMode = DMA_RB_RECOVERY_RESET;
+    ret->writeBase = 0;
+    ret->lastWritePos = 0;
+    ret->lostBytes = 0;
+    ret->abortCount = 0;
+    ret->abortIRQSet = 0;
+    ret->trackWritePos = 0;
+    ret->rearmHeld = 0;
+    ret->rearmPending = 0;
     
-    ret->dataSemaphore = xSemaphoreCreateBinary();
+    ret->wrapTotal = 0;
+    ret->cursors = NULL;
+    ret->cellIRQUsers = 0;
     
-    if(ret->channelHandle == NULL){
-        vPortFree(ret);
-        return NULL;
-    }
+    ret->txTail = 0;
+    ret->txActive = 0;
+    ret->txWrapPos = bufferSize;
+    ret->txReserved = 0;
+    ret->txReserveWrapped = 0;
+    ret->txSentTotal = 0;
+    
+    ret->notifyPolicy = DMA_RB_NOTIFY_CELL;
+    ret->notifyMode = DMA_RB_NOTIFY_CELL;
+    ret->latencyTarget = 1;
+    ret->maxIrqRate = 0;
+    ret->dataRate = 0;
+    ret->wakeLatency = 0;
+    ret->rateLastTotal = 0;
+    ret->rateLastTick = xTaskGetTickCount();
+    ret->notifyTick = 0;
+    
+    ret->channelHandle = channelHandle;
+    ret->data = data;
+    
+    ret->dataSemaphore = xSemaphoreCreateBinary();
+    if(ret->dataSemaphore == NULL) return 0;
         
     DMA_setIRQHandler(ret->channelHandle, DMA_RB_ISR, ret);
-    DMA_setChannelAttributes(ret->channelHandle, 0, 0, 0, 1, prio);
-    DMA_setInterruptConfig(ret->channelHandle, 0,0,0,0,0,0,1,1);
+    //the write position and total look at the pending block done/abort flags, those are already cleared once a deferred event gets handled
+    DMA_pinIRQ(ret->channelHandle);
+    //a TX channel only runs while there is something to send, so no auto enable there
+    DMA_setChannelAttributes(ret->channelHandle, 0, 0, 0, (direction == RINGBUFFER_DIRECTION_RX), prio);
+    //block done is needed in both directions, RX uses it to count buffer wraps and TX to send the next chunk
+    DMA_setInterruptConfig(ret->channelHandle, 0,0,0,0,1,0,1,1);
     DMA_setTransferAttributes(ret->channelHandle, dataSize, dataReadyInt, -1);
     DMA_setIRQEnabled(ret->channelHandle, 1);
     
-    ret->data = SYS_makeCoherent(pvPortMalloc(bufferSize));
-    
     if(direction == RINGBUFFER_DIRECTION_RX){
     
         DMA_setSrcConfig(ret->channelHandle, dataSrc, dataSize);
-        DMA_setDestConfig(ret->channelHandle, ret->data, bufferSize);
+        DMA_setDestConfig(ret->channelHandle, (uint32_t *) ret->data, bufferSize);
         
-    }else if(direction == RINGBUFFER_DIRECTION_TX){
+    }else{
         
+        //the source gets set up for every chunk once data is committed
         DMA_setDestConfig(ret->channelHandle, dataSrc, dataSize);
-        DMA_setSrcConfig(ret->channelHandle, ret->data, bufferSize);
         
-    }else{
-        DMA_freeChannel(ret->channelHandle);
-        vPortFree(ret);
-        return NULL;
     }
     
-    //and finally enable the DMA channel
-    DMA_setEnabled(ret->channelHandle, 1);
+    //and finally enable the DMA channel. TX gets enabled by the first commit
+    if(direction == RINGBUFFER_DIRECTION_RX) DMA_setEnabled(ret->channelHandle, 1);
     
-    return ret;
+    return 1;
 }
 
 void DMA_freeRingBuffer(DMA_RingBufferHandle_t * handle){
@@ -67,6 +139,8 @@ void DMA_freeRingBuffer(DMA_RingBufferHandle_t * handle){
     
     DMA_freeChannel(handle->channelHandle);
     
+    while(handle->cursors != NULL) DMA_RB_detachCursor(handle->cursors);
+    
     vSemaphoreDelete(handle->dataSemaphore);
     
     vPortFree(SYS_makeNonCoherent(handle->data));
@@ -79,34 +153,401 @@ void DMA_RB_ISR(uint32_t evt, void * data){
     
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     
+    if(handle->direction == RINGBUFFER_DIRECTION_TX){
+        if((evt & _DCH0INT_CHTAIF_MASK) || (evt & _DCH0INT_CHERIF_MASK)){
+            //transfer aborted, whatever was still queued won't be sent anymore
+            handle->abortCount++;
+            handle->lostBytes += DMA_RB_available(handle);
+            DMA_TRACE(DMA_TRACE_EVT_ABORT, handle->channelHandle->moduleID, evt, handle->lastReadPos);
+            
+            handle->txActive = 0;
+            handle->txTail = handle->lastReadPos;
+            handle->txWrapPos = handle->bufferSize;
+        }else if(evt & _DCH0INT_CHBCIF_MASK){
+            //chunk is out, move on to whatever got committed in the meantime
+            handle->txSentTotal += handle->txActive;
+            uint32_t tail = handle->txTail + handle->txActive;
+            if(tail >= handle->txWrapPos){
+                tail = 0;
+                handle->txWrapPos = handle->bufferSize;
+            }
+            handle->txTail = tail;
+            handle->txActive = 0;
+            
+            //the peripheral is still busy with the last cell, its ready interrupt starts the next chunk
+            DMA_RB_txArm(handle, 0);
+        }
+        
+        //there is space in the buffer again
+        DMA_RB_notify(handle, &xHigherPriorityTaskWoken);
+        DMA_yieldFromHandler(xHigherPriorityTaskWoken);
+        return;
+    }
+    
     //check which event happened
     if((evt & _DCH0INT_CHTAIF_MASK) || (evt & _DCH0INT_CHERIF_MASK)){
-        //transfer aborted or other error => reset data pointers
-        handle->lastReadPos = 0;
+        handle->abortCount++;
         
-        //now re-enable the channel if desired
-        if(handle->restartOnError) DMA_setEnabled(handle->channelHandle, 1);
+        if(handle->direction == RINGBUFFER_DIRECTION_RX && handle->recoveryMode == DMA_RB_RECOVERY_PRESERVE){
+            //keep everything that wasn't read yet and continue writing where the transfer stopped. Whatever got written past the last position we saw is overwritten
+            uint32_t unknown;
+            uint32_t pos = DMA_RB_abortPos(handle, evt, &unknown);
+            handle->lostBytes += unknown;
+            DMA_TRACE(DMA_TRACE_EVT_ABORT, handle->channelHandle->moduleID, evt, pos);
+            DMA_RB_rearmAt(handle, pos, handle->restartOnError);
+        }else{
+            //transfer aborted or other error => reset data pointers. Whatever wasn't read until now is gone
+            if(handle->direction == RINGBUFFER_DIRECTION_RX){
+                uint32_t unknown;
+                uint32_t pos = DMA_RB_abortPos(handle, evt, &unknown);
+                if(pos >= handle->lastReadPos){
+                    handle->lostBytes += pos - handle->lastReadPos + unknown;
+                }else{
+                    handle->lostBytes += pos + handle->bufferSize - handle->lastReadPos + unknown;
+                }
+            }
+            
+            DMA_RB_restartStream(handle);
+            handle->lastReadPos = 0;
+            handle->lastWritePos = 0;
+            DMA_TRACE(DMA_TRACE_EVT_ABORT, handle->channelHandle->moduleID, evt, 0);
+            
+            //now re-enable the channel if desired
+            DMA_RB_rearmAt(handle, 0, handle->restartOnError);
+        }
         
         //now also check if somebody is waiting for data, we should return
-        xSemaphoreGiveFromISR(handle->dataSemaphore, &xHigherPriorityTaskWoken);
+        DMA_RB_notify(handle, &xHigherPriorityTaskWoken);
+    }else if(evt & _DCH0INT_CHBCIF_MASK){
+        //the DMA wrapped around to the start of the buffer
+        handle->wrapTotal += handle->bufferSize;
+        
+        //if that was the partial block after a recovery, move the channel back to the whole buffer
+        if(handle->writeBase != 0) DMA_RB_rearmAt(handle, 0, 1);
     }
     
-    if(evt & _DCH0INT_CHCCIF_MASK){
+    if(evt & (_DCH0INT_CHCCIF_MASK | _DCH0INT_CHDHIF_MASK | _DCH0INT_CHDDIF_MASK)){
         //some DMA event just occurred, tell waiting code that it did so
-        xSemaphoreGiveFromISR(handle->dataSemaphore, &xHigherPriorityTaskWoken);
+        if(handle->direction == RINGBUFFER_DIRECTION_RX) DMA_RB_getWritePos(handle);
+        DMA_RB_notify(handle, &xHigherPriorityTaskWoken);
+        
+        for(DMA_RB_Cursor_t * cursor = handle->cursors; cursor != NULL; cursor = cursor->next){
+            if(cursor->waiting) DMA_semaphoreGiveFromHandler(cursor->dataSemaphore, &xHigherPriorityTaskWoken);
+        }
+    }
+
+    DMA_yieldFromHandler(xHigherPriorityTaskWoken);
+}
+
+//wakes up DMA_RB_waitForData. Every give comes with its tick, otherwise the wake latency gets measured from some older notification
+static inline void DMA_RB_notify(DMA_RingBufferHandle_t * handle, BaseType_t * woken){
+    handle->notifyTick = DMA_getTickCountFromHandler();
+    DMA_semaphoreGiveFromHandler(handle->dataSemaphore, woken);
+}
+
+uint32_t DMA_RB_setRecoveryMode(DMA_RingBufferHandle_t * handle, uint32_t mode){
+    if(mode > DMA_RB_RECOVERY_PRESERVE) return 0;
+    handle->recoveryMode = mode;
+    DMA_RB_updateTracking(handle);
+    return 1;
+}
+
+//keeps the cell interrupt on while an abort can happen, so that the isr knows where the DMA was up to the last cell
+static void DMA_RB_updateTracking(DMA_RingBufferHandle_t * handle){
+    if(handle->direction != RINGBUFFER_DIRECTION_RX) return;
+    
+    uint32_t track = (handle->recoveryMode == DMA_RB_RECOVERY_PRESERVE || handle->abortIRQSet) ? 1 : 0;
+    if(track == handle->trackWritePos) return;
+    
+    handle->trackWritePos = track;
+    DMA_RB_cellIRQRef(handle, track ? 1 : -1);
+}
+
+//where an aborted RX transfer stopped. If the abort already reset the pointer only the last position we saw is left, anything written
+//after it is unknown: the cell that was in flight, and one more if its cell done interrupt came in together with the abort
+static uint32_t DMA_RB_abortPos(DMA_RingBufferHandle_t * handle, uint32_t evt, uint32_t * unknown){
+    if(*(handle->channelHandle->DPTR) != 0){
+        *unknown = 0;
+        return DMA_RB_getWritePos(handle);
     }
+    
+    *unknown = (evt & _DCH0INT_CHCCIF_MASK) ? handle->dataSize * 2 : handle->dataSize;
+    return handle->lastWritePos;
+}
+
+uint32_t DMA_RB_getLostBytes(DMA_RingBufferHandle_t * handle){
+    return handle->lostBytes;
+}
 
-    portEND_SWITCHING_ISR( xHigherPriorityTaskWoken );
+uint32_t DMA_RB_getAbortCount(DMA_RingBufferHandle_t * handle){
+    return handle->abortCount;
+}
+
+//where the DMA is going to write next, relative to the start of the buffer. Also remembers it for abort recovery
+static inline uint32_t DMA_RB_getWritePos(DMA_RingBufferHandle_t * handle){
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    //pointer first, the flags read after it tell whether it was still valid
+    uint32_t dptr = *(handle->channelHandle->DPTR);
+    uint32_t flags = handle->channelHandle->INT->w;
+    
+    //an abort or error already reset the pointer but the isr didn't recover yet. The last position we saw is the best we've got,
+    //remembering the reset pointer instead would make unread data look like free space and old data like new
+    if(flags & (_DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK)){
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        return handle->lastWritePos;
+    }
+    
+    uint32_t pos = 0;
+    
+    //a partial block after a recovery just ended but the isr didn't move the channel back yet => we're at the start of the buffer
+    if(!(handle->writeBase != 0 && (flags & _DCH0INT_CHBCIF_MASK))){
+        pos = handle->writeBase + dptr;
+        if(pos >= handle->bufferSize) pos -= handle->bufferSize;
+    }
+    
+    handle->lastWritePos = pos;
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    return pos;
+}
+
+//(re)starts the channel so that the next byte lands at pos. For pos != 0 the channel only covers the rest of the buffer and 
+//stops at its end, the block done isr then moves it back onto the whole buffer. That way no unread data gets overwritten
+static void DMA_RB_rearmAt(DMA_RingBufferHandle_t * handle, uint32_t pos, uint32_t enable){
+    DmaHandle_t * channel = handle->channelHandle;
+    if(pos >= handle->bufferSize) pos = 0;
+    
+    handle->writeBase = pos;
+    
+    if(handle->direction == RINGBUFFER_DIRECTION_RX){
+        DMA_setDestConfig(channel, (uint32_t *) &handle->data[pos], handle->bufferSize - pos);
+        DMA_setChannelAttributes(channel, -1, -1, -1, (pos == 0), -1);
+    }
+    
+    //DMA_RB_setBuffer is still copying into the new buffer, it enables the channel once that's done
+    if(enable && handle->rearmHeld){
+        handle->rearmPending = 1;
+        enable = 0;
+    }
+    
+    if(enable) DMA_setEnabled(channel, 1);
 }
 
 void DMA_RB_setAbortIRQ(DMA_RingBufferHandle_t * handle, uint32_t abortIrq, uint32_t autoRestart){
     handle->restartOnError = autoRestart;
+    handle->abortIRQSet = (abortIrq != (uint32_t) -1);
     DMA_setTransferAttributes(handle->channelHandle, handle->dataSize, handle->dataReadyInt, abortIrq);
+    DMA_RB_updateTracking(handle);
 }
 
+//points the ring at a different peripheral register (the source for RX, the destination for TX). Nothing gets dropped, the stream only pauses while the registers are switched
 void DMA_RB_setDataSrc(DMA_RingBufferHandle_t * handle, void * newDataSrc){
-    DMA_setSrcConfig(handle->channelHandle, newDataSrc, handle->bufferSize);
-    DMA_RB_flush(handle);
+    taskENTER_CRITICAL();
+    
+    uint32_t wasEnabled = DMA_RB_halt(handle);
+    
+    if(handle->direction == RINGBUFFER_DIRECTION_RX){
+        DMA_setSrcConfig(handle->channelHandle, newDataSrc, handle->dataSize);
+        
+        //writing the source resets the pointers, so continue at the position the channel stopped at
+        DMA_RB_rearmAt(handle, handle->lastWritePos, wasEnabled);
+    }else{
+        DMA_setDestConfig(handle->channelHandle, newDataSrc, handle->dataSize);
+        //the new peripheral most likely sits there idle, its ready interrupt is long gone
+        DMA_RB_txArm(handle, 1);
+    }
+    
+    taskEXIT_CRITICAL();
+}
+
+//stops the channel without losing track of where it was. For RX the write position ends up in lastWritePos and a pending wrap gets counted, 
+//for TX the part of the running chunk that already went out is retired. Returns whether the channel was running (or would be restarted after a
+//pending abort). Must be called with interrupts disabled
+static uint32_t DMA_RB_halt(DMA_RingBufferHandle_t * handle){
+    DmaHandle_t * channel = handle->channelHandle;
+    
+    uint32_t wasEnabled = DMA_isEnabled(channel) ? 1 : 0;
+    DMA_setEnabled(channel, 0);
+    while(DMA_isBusy(channel));
+    
+    uint32_t flags = channel->INT->w;
+    uint32_t blockDone = flags & _DCH0INT_CHBCIF_MASK;
+    
+    if(handle->direction == RINGBUFFER_DIRECTION_RX && (flags & (_DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK))){
+        //an abort came in before we stopped the channel. The caller rearms it before the isr gets to see that, so deal with it here the way
+        //PRESERVE would: keep the data, count what got written past the last position we saw and ignore the wrap like the isr does
+        uint32_t unknown;
+        DMA_clearIF(channel, _DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK | _DCH0INT_CHBCIF_MASK);
+        DMA_RB_abortPos(handle, flags, &unknown);
+        
+        handle->abortCount++;
+        handle->lostBytes += unknown;
+        DMA_TRACE(DMA_TRACE_EVT_ABORT, channel->moduleID, flags, handle->lastWritePos);
+        
+        wasEnabled = handle->restartOnError;
+    }else if(handle->direction == RINGBUFFER_DIRECTION_RX){
+        DMA_RB_getWritePos(handle);
+        
+        //do what the isr would have done with the wrap, the channel gets rearmed by the caller anyway
+        if(blockDone){
+            handle->wrapTotal += handle->bufferSize;
+            DMA_clearIF(channel, _DCH0INT_CHBCIF_MASK);
+        }
+    }else if(handle->txActive){
+        uint32_t sent = blockDone ? handle->txActive : *(channel->SPTR);
+        DMA_clearIF(channel, _DCH0INT_CHBCIF_MASK);
+        handle->txSentTotal += sent;
+        
+        uint32_t tail = handle->txTail + sent;
+        if(tail >= handle->txWrapPos){
+            tail = 0;
+            handle->txWrapPos = handle->bufferSize;
+        }
+        handle->txTail = tail;
+        handle->txActive = 0;
+    }
+    
+    return wasEnabled;
+}
+
+//moves the ring into newData (newSize bytes of coherent memory) while it keeps running on the same channel. Unread data is carried over,
+//for RX rings the oldest data (of the main reader and all cursors) is dropped if it doesn't fit and counted as lost/overrun. TX rings fail if the queued data doesn't fit.
+//A pending DMA_RB_reserve is cancelled. Returns the old buffer which now belongs to the caller, or NULL if nothing was changed
+uint8_t * DMA_RB_setBuffer(DMA_RingBufferHandle_t * handle, uint8_t * newData, uint32_t newSize){
+    //the ring always needs to hold whole cells, and RX rings have to fit into one block
+    newSize -= newSize % handle->dataSize;
+    if(newData == NULL || newSize < 2 * handle->dataSize) return NULL;
+    if(handle->direction == RINGBUFFER_DIRECTION_RX && newSize > DMA_MAXBLOCKSIZE) return NULL;
+    
+    uint8_t * oldData = handle->data;
+    uint32_t oldSize = handle->bufferSize;
+    
+    //no other task may touch the ring while it moves. The channel is halted, so its isr stays quiet too
+    vTaskSuspendAll();
+    
+    taskENTER_CRITICAL();
+    uint32_t wasEnabled = DMA_RB_halt(handle);
+    taskEXIT_CRITICAL();
+    
+    if(handle->direction == RINGBUFFER_DIRECTION_RX){
+        uint32_t writePos = handle->lastWritePos;
+        uint32_t writeTotal = handle->wrapTotal + writePos;
+        
+        //figure out how far back the slowest reader is
+        uint32_t mainLag = (writePos >= handle->lastReadPos) ? (writePos - handle->lastReadPos) : (writePos + oldSize - handle->lastReadPos);
+        uint32_t keep = mainLag;
+        
+        for(DMA_RB_Cursor_t * cursor = handle->cursors; cursor != NULL; cursor = cursor->next){
+            uint32_t lag = writeTotal - cursor->readTotal;
+            if(lag > oldSize) lag = oldSize;
+            if(lag > keep) keep = lag;
+        }
+        
+        //the DMA needs at least a cell of space in front of the readers
+        if(keep > newSize - handle->dataSize) keep = newSize - handle->dataSize;
+        
+        if(mainLag > keep){
+            handle->lostBytes += mainLag - keep;
+            mainLag = keep;
+        }
+        
+        for(DMA_RB_Cursor_t * cursor = handle->cursors; cursor != NULL; cursor = cursor->next){
+            uint32_t lag = writeTotal - cursor->readTotal;
+            if(lag > keep){
+                cursor->overrunBytes += lag - keep;
+                cursor->overrunCount++;
+                cursor->readTotal = writeTotal - keep;
+            }
+            
+            //cursors that were allowed to use the whole buffer keep doing so
+            if(cursor->overrunThreshold >= oldSize - handle->dataSize || cursor->overrunThreshold > newSize - handle->dataSize) cursor->overrunThreshold = newSize - handle->dataSize;
+        }
+        
+        //stream positions stay the same, data[0] now just holds an older one. The channel continues behind the kept data right away, so the
+        //peripheral only has to wait for the bookkeeping above and not for the copy
+        taskENTER_CRITICAL();
+        handle->data = newData;
+        handle->bufferSize = newSize;
+        handle->wrapTotal = writeTotal - keep;
+        handle->lastWritePos = keep;
+        handle->lastReadPos = keep - mainLag;
+        
+        DMA_RB_rearmAt(handle, keep, wasEnabled);
+        
+        //the DMA must not get back to the start while the copy below still fills it. If it finishes the rest of the buffer (or an abort restarts it)
+        //before we're done the isr only sets the channel up, enabling it is left to us
+        handle->rearmHeld = 1;
+        handle->rearmPending = 0;
+        taskEXIT_CRITICAL();
+        
+        //now copy the newest keep bytes to [0, keep) of the new buffer, in two parts if they wrap around the end of the old one. Readers can't get
+        //to it before we're done since the scheduler is still suspended
+        uint32_t start = (writePos >= keep) ? (writePos - keep) : (writePos + oldSize - keep);
+        uint32_t first = oldSize - start;
+        if(first > keep) first = keep;
+        
+        memcpy(newData, &oldData[start], first);
+        if(keep > first) memcpy(&newData[first], oldData, keep - first);
+        
+        taskENTER_CRITICAL();
+        handle->rearmHeld = 0;
+        if(handle->rearmPending) DMA_setEnabled(handle->channelHandle, 1);
+        handle->rearmPending = 0;
+        taskEXIT_CRITICAL();
+    }else{
+        uint32_t queued = DMA_RB_available(handle);
+        
+        //one byte always stays free, see DMA_RB_reserve
+        if(queued >= newSize){
+            taskENTER_CRITICAL();
+            DMA_RB_txArm(handle, !wasEnabled);
+            taskEXIT_CRITICAL();
+            
+            xTaskResumeAll();
+            return NULL;
+        }
+        
+        uint32_t tail = handle->txTail;
+        uint32_t first = ((handle->lastReadPos >= tail) ? handle->lastReadPos : handle->txWrapPos) - tail;
+        
+        memcpy(newData, &oldData[tail], first);
+        if(queued > first) memcpy(&newData[first], oldData, queued - first);
+        
+        taskENTER_CRITICAL();
+        handle->data = newData;
+        handle->bufferSize = newSize;
+        handle->txTail = 0;
+        handle->lastReadPos = queued;
+        handle->txWrapPos = newSize;
+        handle->txReserved = 0;
+        handle->txReserveWrapped = 0;
+        
+        //the peripheral ran dry during the copy
+        DMA_RB_txArm(handle, 1);
+        taskEXIT_CRITICAL();
+    }
+    
+    xTaskResumeAll();
+    
+    return oldData;
+}
+
+//DMA_RB_setBuffer for rings created with DMA_createRingBuffer, allocates the new buffer and frees the old one
+uint32_t DMA_RB_resize(DMA_RingBufferHandle_t * handle, uint32_t newSize){
+    uint8_t * newData = pvPortMalloc(newSize);
+    if(newData == NULL) return 0;
+    newData = SYS_makeCoherent(newData);
+    
+    uint8_t * oldData = DMA_RB_setBuffer(handle, newData, newSize);
+    if(oldData == NULL){
+        vPortFree(SYS_makeNonCoherent(newData));
+        return 0;
+    }
+    
+    vPortFree(SYS_makeNonCoherent(oldData));
+    return 1;
 }
 
 #pragma GCC push_options
@@ -115,16 +556,19 @@ void DMA_RB_setDataSrc(DMA_RingBufferHandle_t * handle, void * newDataSrc){
 //returns either the amount of data available for reading or the of amount of data available for the dma to write to the target
 uint32_t DMA_RB_available(DMA_RingBufferHandle_t * handle){
     if(handle->direction == RINGBUFFER_DIRECTION_RX){
-        if(*(handle->channelHandle->DPTR) >= handle->lastReadPos){
-            return *(handle->channelHandle->DPTR) - handle->lastReadPos;
+        uint32_t writePos = DMA_RB_getWritePos(handle);
+        if(writePos >= handle->lastReadPos){
+            return writePos - handle->lastReadPos;
         }else{
-            return (*(handle->channelHandle->DPTR) + handle->bufferSize) - handle->lastReadPos;
+            return (writePos + handle->bufferSize) - handle->lastReadPos;
         }
     }else{
-        if(*(handle->channelHandle->DPTR) <= handle->lastReadPos){
-            return handle->lastReadPos - *(handle->channelHandle->DPTR);
+        //everything between the tail and the producer position is still waiting to be sent
+        uint32_t tail = handle->txTail;
+        if(handle->lastReadPos >= tail){
+            return handle->lastReadPos - tail;
         }else{
-            return handle->lastReadPos + handle->bufferSize - *(handle->channelHandle->DPTR);
+            return handle->txWrapPos - tail + handle->lastReadPos;
         }
     }
 }
@@ -133,18 +577,38 @@ uint32_t DMA_RB_availableWords(DMA_RingBufferHandle_t * handle){
     return DMA_RB_available(handle) / handle->dataSize;
 }
 
+//moves the main reader on to readPos, unless an abort came in since aborts was taken. Without preserving recovery the isr already reset the read
+//position and counted the unread data as lost, whatever the caller read is stale then. With it the read position stays where it was and the
+//data just gets read again. Returns whether the read counts
+static uint32_t DMA_RB_commitRead(DMA_RingBufferHandle_t * handle, uint32_t aborts, uint32_t readPos){
+    taskENTER_CRITICAL();
+    uint32_t valid = (handle->abortCount == aborts);
+    if(valid) handle->lastReadPos = readPos;
+    taskEXIT_CRITICAL();
+    
+    return valid;
+}
+
 uint32_t DMA_RB_read(DMA_RingBufferHandle_t * handle, uint8_t * dst, uint32_t size){
     if(handle->direction != RINGBUFFER_DIRECTION_RX) return 0;
     
+    //the isr might restart the stream while we copy, so the read position only gets moved once we're done. See DMA_RB_commitRead
+    uint32_t aborts = handle->abortCount;
     uint32_t available = DMA_RB_available(handle);
     if(size > available) size = available;
     
     uint32_t currPos = 0;
-    while((handle->lastReadPos != *(handle->channelHandle->DPTR)) && (currPos != size)){
-        dst[currPos++] = handle->data[handle->lastReadPos++];
-        if(handle->lastReadPos >= handle->bufferSize) handle->lastReadPos = 0;
+    uint32_t readPos = handle->lastReadPos;
+    uint32_t writePos = handle->lastWritePos;
+    while((readPos != writePos) && (currPos != size)){
+        dst[currPos++] = handle->data[readPos++];
+        if(readPos >= handle->bufferSize) readPos = 0;
     }
     
+    if(!DMA_RB_commitRead(handle, aborts, readPos)) currPos = 0;
+    
+    DMA_TRACE(DMA_TRACE_EVT_RB_READ, handle->channelHandle->moduleID, currPos, handle->lastReadPos);
+    
     //return however many bytes were read, even if we stopped reading due to a buffer underflow for some reason
     return currPos;
 }
@@ -153,6 +617,7 @@ uint32_t DMA_RB_readWords(DMA_RingBufferHandle_t * handle, uint8_t * dst, uint32
     if(handle->direction != RINGBUFFER_DIRECTION_RX) return 0;
     
     //check how many words can actually be read
+    uint32_t aborts = handle->abortCount;
     uint32_t available = DMA_RB_available(handle);
     if(size > (available / handle->dataSize)) size = available / handle->dataSize;
     if(size == 0){ 
@@ -164,14 +629,20 @@ uint32_t DMA_RB_readWords(DMA_RingBufferHandle_t * handle, uint8_t * dst, uint32
     
     //perform the read
     uint32_t currPos = 0;
-    while((handle->lastReadPos != *(handle->channelHandle->DPTR)) && (currPos != size)){
-        dst[currPos++] = handle->data[handle->lastReadPos++];
-        if(handle->lastReadPos >= handle->bufferSize) handle->lastReadPos = 0;
+    uint32_t readPos = handle->lastReadPos;
+    uint32_t writePos = handle->lastWritePos;
+    while((readPos != writePos) && (currPos != size)){
+        dst[currPos++] = handle->data[readPos++];
+        if(readPos >= handle->bufferSize) readPos = 0;
     }
     
+    if(!DMA_RB_commitRead(handle, aborts, readPos)) currPos = 0;
+    
     /*if(size != 24) configASSERT(0);
     if(currPos != 24) configASSERT(0);*/
     
+    DMA_TRACE(DMA_TRACE_EVT_RB_READ, handle->channelHandle->moduleID, currPos, handle->lastReadPos);
+    
     //return however many bytes were read, even if we stopped reading due to a buffer underflow for some reason
     return currPos / handle->dataSize;
 }
@@ -180,97 +651,385 @@ uint32_t DMA_RB_readWordPtr(DMA_RingBufferHandle_t * handle, void ** dst){
     if(handle->direction != RINGBUFFER_DIRECTION_RX) return 0;
     
     //check how many words can actually be read
+    uint32_t aborts = handle->abortCount;
     uint32_t available = DMA_RB_available(handle);
     if(available < handle->dataSize) return 0;
     
     //check if the buffer is aligned to the buffer boundaries
-    if(handle->lastReadPos + handle->dataSize > handle->bufferSize){
+    uint32_t readPos = handle->lastReadPos;
+    if(readPos + handle->dataSize > handle->bufferSize){
         //yes, this is shit and needs to be handled somehow. Not that I'd know how right now though lol
         configASSERT(0);
     }
     
     //forward the pointer
-    *dst = &handle->data[handle->lastReadPos];
-    handle->lastReadPos += handle->dataSize;
+    *dst = &handle->data[readPos];
+    readPos += handle->dataSize;
     
-    if(handle->lastReadPos == handle->bufferSize){
-        handle->lastReadPos = 0;
+    if(readPos == handle->bufferSize){
+        readPos = 0;
     }
     
+    if(!DMA_RB_commitRead(handle, aborts, readPos)) return 0;
+    
+    DMA_TRACE(DMA_TRACE_EVT_RB_READ, handle->channelHandle->moduleID, handle->dataSize, handle->lastReadPos);
+    
     //return however many bytes were read, even if we stopped reading due to a buffer underflow for some reason
     return 1;
 }
 
+//batched version of DMA_RB_readWordPtr: fills dst with pointers to up to maxCount records and moves the read position only once
+uint32_t DMA_RB_readWordPtrs(DMA_RingBufferHandle_t * handle, void ** dst, uint32_t maxCount){
+    if(handle->direction != RINGBUFFER_DIRECTION_RX) return 0;
+    
+    uint32_t aborts = handle->abortCount;
+    uint32_t count = DMA_RB_available(handle) / handle->dataSize;
+    if(count > maxCount) count = maxCount;
+    if(count == 0) return 0;
+    
+    uint32_t pos = handle->lastReadPos;
+    uint8_t * data = handle->data;
+    
+    for(uint32_t i = 0; i < count; i++){
+        dst[i] = &data[pos];
+        pos += handle->dataSize;
+        
+        if(pos >= handle->bufferSize){
+            //same as in DMA_RB_readWordPtr, records crossing the end of the buffer can't be returned as a pointer
+            if(pos > handle->bufferSize) configASSERT(0);
+            pos = 0;
+        }
+    }
+    
+    if(!DMA_RB_commitRead(handle, aborts, pos)) return 0;
+    DMA_TRACE(DMA_TRACE_EVT_RB_READ, handle->channelHandle->moduleID, count * handle->dataSize, pos);
+    
+    return count;
+}
+
+//returns a pointer to the first of up to maxCount records lying back to back in the buffer, stops at the end of the buffer
+uint32_t DMA_RB_readWordRun(DMA_RingBufferHandle_t * handle, void ** dst, uint32_t maxCount){
+    if(handle->direction != RINGBUFFER_DIRECTION_RX) return 0;
+    
+    uint32_t aborts = handle->abortCount;
+    uint32_t count = DMA_RB_available(handle) / handle->dataSize;
+    uint32_t readPos = handle->lastReadPos;
+    uint32_t contiguous = (handle->bufferSize - readPos) / handle->dataSize;
+    if(count > contiguous) count = contiguous;
+    if(count > maxCount) count = maxCount;
+    if(count == 0) return 0;
+    
+    *dst = &handle->data[readPos];
+    
+    readPos += count * handle->dataSize;
+    if(readPos >= handle->bufferSize) readPos = 0;
+    if(!DMA_RB_commitRead(handle, aborts, readPos)) return 0;
+    DMA_TRACE(DMA_TRACE_EVT_RB_READ, handle->channelHandle->moduleID, count * handle->dataSize, readPos);
+    
+    return count;
+}
+
 #pragma GCC pop_options
 
 uint32_t DMA_RB_write(DMA_RingBufferHandle_t * handle, uint8_t * src, uint32_t size){
     if(handle->direction != RINGBUFFER_DIRECTION_TX) return 0;
-    uint32_t available = handle->bufferSize - 1 - DMA_RB_available(handle);
+    
+    DMA_RB_Span_t span;
+    uint32_t available = DMA_RB_reserve(handle, 1, &span, 0);
     if(size > available) size = available;
+    if(size == 0) return 0;
     
-    uint32_t currPos = 0;
-    while((handle->lastReadPos != *(handle->channelHandle->DPTR)) && (currPos != size)){
-        handle->data[handle->lastReadPos++] = src[currPos++];
-        if(handle->lastReadPos >= handle->bufferSize) handle->lastReadPos = 0;
-    }
+    uint32_t first = (size > span.length[0]) ? span.length[0] : size;
+    memcpy(span.ptr[0], src, first);
+    if(size > first) memcpy(span.ptr[1], &src[first], size - first);
+    
+    DMA_RB_commit(handle, size);
     
     return size;
 }
 
+//reserves all free space in the TX buffer if there are at least minBytes. The space is returned as up to two spans (end and start of the buffer)
+//or, with DMA_RB_RESERVE_CONTIGUOUS, as a single span which might skip the end of the buffer. Returns the number of bytes reserved or 0
+uint32_t DMA_RB_reserve(DMA_RingBufferHandle_t * handle, uint32_t minBytes, DMA_RB_Span_t * span, uint32_t flags){
+    span->ptr[0] = span->ptr[1] = NULL;
+    span->length[0] = span->length[1] = 0;
+    
+    handle->txReserved = 0;
+    handle->txReserveWrapped = 0;
+    
+    if(handle->direction != RINGBUFFER_DIRECTION_TX) return 0;
+    
+    //the tail only ever moves towards the head, so reading it once is safe. Worst case we see a little less space than there is
+    uint32_t head = handle->lastReadPos;
+    uint32_t tail = handle->txTail;
+    
+    if(head >= tail){
+        //one byte always stays free so a full buffer doesn't look empty
+        uint32_t endSpace = handle->bufferSize - head;
+        uint32_t startSpace = tail;
+        if(tail == 0) endSpace--; else startSpace--;
+        
+        if(flags & DMA_RB_RESERVE_CONTIGUOUS){
+            if(endSpace >= minBytes && endSpace > 0){
+                span->ptr[0] = &handle->data[head];
+                span->length[0] = endSpace;
+            }else if(startSpace >= minBytes && startSpace > 0){
+                //not enough room at the end, the data will continue at the start of the buffer and the end gets skipped
+                span->ptr[0] = handle->data;
+                span->length[0] = startSpace;
+                handle->txReserveWrapped = 1;
+            }else{
+                return 0;
+            }
+        }else{
+            if(endSpace + startSpace < minBytes || endSpace + startSpace == 0) return 0;
+            
+            if(endSpace > 0){
+                span->ptr[0] = &handle->data[head];
+                span->length[0] = endSpace;
+                span->ptr[1] = handle->data;
+                span->length[1] = startSpace;
+            }else{
+                span->ptr[0] = handle->data;
+                span->length[0] = startSpace;
+            }
+        }
+    }else{
+        uint32_t space = tail - head - 1;
+        if(space < minBytes || space == 0) return 0;
+        
+        span->ptr[0] = &handle->data[head];
+        span->length[0] = space;
+    }
+    
+    handle->txReserved = span->length[0] + span->length[1];
+    return handle->txReserved;
+}
+
+//hands the first bytes of the last reservation over to the DMA. Starts the channel if it is idle, otherwise the data goes out right after the current chunk
+uint32_t DMA_RB_commit(DMA_RingBufferHandle_t * handle, uint32_t bytes){
+    if(handle->direction != RINGBUFFER_DIRECTION_TX) return 0;
+    if(bytes > handle->txReserved) bytes = handle->txReserved;
+    
+    taskENTER_CRITICAL();
+    
+    uint32_t head = handle->lastReadPos;
+    
+    if(handle->txReserveWrapped && bytes > 0){
+        //data continues at the start of the buffer. If nothing is queued the tail can just follow, otherwise the DMA needs to know where to wrap
+        if(handle->txTail == head){
+            handle->txTail = 0;
+        }else{
+            handle->txWrapPos = head;
+        }
+        head = 0;
+    }
+    
+    head += bytes;
+    if(head >= handle->bufferSize) head -= handle->bufferSize;
+    handle->lastReadPos = head;
+    
+    handle->txReserved = 0;
+    handle->txReserveWrapped = 0;
+    
+    //only does something if the ring was idle, so the peripheral already asked for data and won't do so again
+    DMA_RB_txArm(handle, 1);
+    
+    taskEXIT_CRITICAL();
+    
+    DMA_TRACE(DMA_TRACE_EVT_RB_WRITE, handle->channelHandle->moduleID, bytes, head);
+    
+    return bytes;
+}
+
+//starts sending the next contiguous chunk if the channel is idle. Called with interrupts disabled or from the isr
+//the ready interrupt only starts a cell when it comes in, so when the ring was idle the first cell is forced. That needs the peripheral to take a
+//cell without asking for it first, even right after the previous one went in (a fifo or buffer of at least two cells like the UART or the SPI
+//enhanced buffer). Without that, dataReadyInt must be a level sensitive request that keeps coming while the peripheral has room
+static void DMA_RB_txArm(DMA_RingBufferHandle_t * handle, uint32_t force){
+    if(handle->txActive) return;
+    
+    uint32_t tail = handle->txTail;
+    uint32_t head = handle->lastReadPos;
+    if(tail == head) return;
+    
+    uint32_t length = (head > tail) ? (head - tail) : (handle->txWrapPos - tail);
+    if(length > DMA_MAXBLOCKSIZE) length = DMA_MAXBLOCKSIZE;
+    
+    handle->txActive = length;
+    DMA_setSrcConfig(handle->channelHandle, (uint32_t *) &handle->data[tail], length);
+    DMA_setEnabled(handle->channelHandle, 1);
+    if(force) DMA_forceTransfer(handle->channelHandle);
+}
+
 uint32_t DMA_RB_readSB(DMA_RingBufferHandle_t * handle, StreamBufferHandle_t buffer, uint32_t size){
     if(handle->direction != RINGBUFFER_DIRECTION_RX) return 0;
     
+    uint32_t aborts = handle->abortCount;
     uint32_t available = DMA_RB_available(handle);
     if(size > available) size = available;
     uint32_t freeSpace = xStreamBufferSpacesAvailable(buffer);
     if(size > freeSpace) size = freeSpace;
     
-    uint8_t * dataStartAddr = (uint8_t *) ((uint32_t) handle->data + handle->lastReadPos);
-    
     if(size == 0) return 0;
     
     //let the xStreamBufferSend routine copy all the data itself, but make sure we take a buffer wraparound into account
-    uint32_t bytesWritten = 0;
-    if(*(handle->channelHandle->DPTR) >= handle->lastReadPos){
-        bytesWritten = xStreamBufferSend(buffer, dataStartAddr, size, 0);
-        handle->lastReadPos += bytesWritten;
-        if(handle->lastReadPos >= handle->bufferSize) handle->lastReadPos = 0;
-    }else{
-        //start with the date between current read pointer and buffer end
-        uint32_t bytesRemaining = size;
-        bytesWritten = xStreamBufferSend(buffer, dataStartAddr, handle->bufferSize - handle->lastReadPos, 0);
-        handle->lastReadPos += bytesWritten;
-        size -= bytesWritten;
-        
-        //did we read everything? should return normally due to space check above, but make sure just incase
-        if(handle->lastReadPos != handle->bufferSize){
-            return bytesWritten;
+    //the stream buffer's storage is private to FreeRTOS so this has to stay a cpu copy, use DMA_RB_drain for large linear sinks
+    uint32_t readPos = handle->lastReadPos;
+    uint32_t first = handle->bufferSize - readPos;
+    if(first > size) first = size;
+    
+    uint32_t bytesWritten = xStreamBufferSend(buffer, &handle->data[readPos], first, 0);
+    
+    //copy the part at the start of the buffer, unless the stream buffer somehow ran full already
+    if(bytesWritten == first && size > first) bytesWritten += xStreamBufferSend(buffer, handle->data, size - first, 0);
+    
+    //the data is in the stream buffer already, but the read position must not end up in the middle of a restarted stream
+    readPos += bytesWritten;
+    if(readPos >= handle->bufferSize) readPos -= handle->bufferSize;
+    DMA_RB_commitRead(handle, aborts, readPos);
+    
+    DMA_TRACE(DMA_TRACE_EVT_RB_READ, handle->channelHandle->moduleID, bytesWritten, handle->lastReadPos);
+    
+    return bytesWritten;
+}
+
+//moves up to size bytes out of the ring into dst. Anything from DMA_RB_DRAIN_THRESHOLD bytes on gets copied by memory to memory DMA transfers (one per
+//segment if the data wraps around the end of the ring) while the calling task sleeps, smaller amounts are just memcpy'd. 
+//dst has to be coherent memory. If the DMA doesn't get done within timeout the data is copied by the cpu after all, so this always returns the number of bytes read.
+//Without DMA_USE_ASYNC everything is memcpy'd and timeout is ignored
+uint32_t DMA_RB_drain(DMA_RingBufferHandle_t * handle, uint8_t * dst, uint32_t size, uint32_t timeout){
+    if(handle->direction != RINGBUFFER_DIRECTION_RX) return 0;
+    
+    uint32_t aborts = handle->abortCount;
+    uint32_t available = DMA_RB_available(handle);
+    if(size > available) size = available;
+    if(size == 0) return 0;
+    
+    uint32_t readPos = handle->lastReadPos;
+    uint32_t first = handle->bufferSize - readPos;
+    if(first > size) first = size;
+    
+    uint8_t * segSrc[2] = {&handle->data[readPos], handle->data};
+    uint8_t * segDst[2] = {dst, &dst[first]};
+    uint32_t segLength[2] = {first, size - first};
+    uint32_t segments = (size > first) ? 2 : 1;
+    uint32_t copied[2] = {0, 0};
+    
+#if DMA_USE_ASYNC
+    if(size >= DMA_RB_DRAIN_THRESHOLD){
+        DMA_Token_t tokens[2] = {DMA_TOKEN_INVALID, DMA_TOKEN_INVALID};
+        
+        //a memory to memory copy is a single forced cell covering the whole segment
+        for(uint32_t i = 0; i < segments; i++){
+            tokens[i] = DMA_submit(segSrc[i], segLength[i], segDst[i], segLength[i], segLength[i], -1, handle->channelHandle->CON->CHPRI, NULL, NULL);
         }
         
-        //copy the remaining part of the data
-        handle->lastReadPos = 0;
-        bytesWritten += xStreamBufferSend(buffer, dataStartAddr, bytesRemaining, 0);
+        for(uint32_t i = 0; i < segments; i++){
+            if(tokens[i] == DMA_TOKEN_INVALID) continue;
+            
+            if(DMA_wait(tokens[i], timeout, NULL) & _DCH0INT_CHBCIF_MASK){
+                copied[i] = 1;
+            }else{
+                DMA_cancel(tokens[i]);
+            }
+        }
     }
+#else
+    (void)timeout;
+#endif
     
-    return bytesWritten;
+    //whatever the DMA didn't take care of gets copied here
+    for(uint32_t i = 0; i < segments; i++){
+        if(!copied[i]) memcpy(segDst[i], segSrc[i], segLength[i]);
+    }
+    
+    //only now is the data out of the way of the DMA
+    readPos += size;
+    if(readPos >= handle->bufferSize) readPos -= handle->bufferSize;
+    if(!DMA_RB_commitRead(handle, aborts, readPos)) return 0;
+    
+    DMA_TRACE(DMA_TRACE_EVT_RB_READ, handle->channelHandle->moduleID, size, readPos);
+    
+    return size;
 }
 
 uint32_t DMA_RB_flush(DMA_RingBufferHandle_t * handle){
-    uint32_t reEnable = 0;
-    if(DMA_isEnabled(handle->channelHandle)) reEnable = 1;
+    //stop the channel before counting, otherwise whatever it writes until the abort is dropped without showing up in lostBytes
+    taskENTER_CRITICAL();
+    uint32_t reEnable = DMA_RB_halt(handle);
+    
+    //whatever is still in the buffer now gets dropped. DMA_RB_halt already put the write position into lastWritePos
+    uint32_t dropped;
+    if(handle->direction == RINGBUFFER_DIRECTION_RX){
+        dropped = (handle->lastWritePos >= handle->lastReadPos) ? (handle->lastWritePos - handle->lastReadPos) : (handle->lastWritePos + handle->bufferSize - handle->lastReadPos);
+    }else{
+        dropped = DMA_RB_available(handle);
+    }
+    DMA_TRACE(DMA_TRACE_EVT_RB_FLUSH, handle->channelHandle->moduleID, 0, dropped);
+    handle->lostBytes += dropped;
     
+    //clear the abort flag right away, the isr must not try to recover from an abort we did on purpose
     DMA_abortTransfer(handle->channelHandle);
-    handle->lastReadPos = 0;
+    DMA_clearIF(handle->channelHandle, 0xff);
     
-    if(reEnable) DMA_setEnabled(handle->channelHandle, 1);
+    //everything up to the rearm happens in one go. The abort reset the pointer, cursors must not see that before the positions are reset as well
+    if(handle->direction == RINGBUFFER_DIRECTION_TX){
+        //nothing left to send, the channel stays off until the next commit
+        handle->lastReadPos = 0;
+        handle->txTail = 0;
+        handle->txActive = 0;
+        handle->txWrapPos = handle->bufferSize;
+        handle->txReserved = 0;
+    }else{
+        DMA_RB_restartStream(handle);
+        handle->lastReadPos = 0;
+        handle->lastWritePos = 0;
+        
+        DMA_RB_rearmAt(handle, 0, reEnable);
+    }
+    taskEXIT_CRITICAL();
+    
+    return 1;
+}
+
+uint32_t DMA_RB_setNotifyPolicy(DMA_RingBufferHandle_t * handle, uint32_t policy, uint32_t latencyTarget, uint32_t maxIrqRate){
+    if(policy > DMA_RB_NOTIFY_ADAPTIVE) return 0;
+    
+    handle->notifyPolicy = policy;
+    handle->notifyMode = (policy == DMA_RB_NOTIFY_ADAPTIVE) ? DMA_RB_NOTIFY_CELL : policy;
+    handle->latencyTarget = (latencyTarget == 0) ? 1 : latencyTarget;
+    handle->maxIrqRate = maxIrqRate;
+    
+    return 1;
 }
 
 uint32_t DMA_RB_waitForData(DMA_RingBufferHandle_t * handle, uint32_t timeout){
+    DMA_RB_updateRate(handle);
+    
     //is there already some data in the buffer?
     if(DMA_RB_available(handle) > 0) return 1; //yes, just return
     
+    if(handle->notifyPolicy == DMA_RB_NOTIFY_ADAPTIVE) handle->notifyMode = DMA_RB_selectNotifyMode(handle);
+    uint32_t mode = handle->notifyMode;
+    
+    //check if timeout is reasonable (if its too long we might get stuck if isr somehow isn't called) TODO: evaluate and make it reliable
+    if(timeout > 10000) timeout = 10000;
+    
+    if(mode == DMA_RB_NOTIFY_TIMEOUT){
+        //no interrupts at all, just check back every latencyTarget ticks
+        while(timeout > 0){
+            uint32_t delay = (timeout > handle->latencyTarget) ? handle->latencyTarget : timeout;
+            vTaskDelay(delay);
+            timeout -= delay;
+            
+            if(DMA_RB_available(handle) > 0) return 1;
+        }
+        return 0;
+    }
+    
     //no, no data in the buffer at the moment, enable irq
-    DMA_setInterruptConfig(handle->channelHandle, -1, -1, -1, -1, -1, 1, -1, -1);
+    DMA_RB_setNotifyIRQ(handle, mode, 1);
     
     //and finally wait for the irq to be called
     
@@ -278,18 +1037,324 @@ uint32_t DMA_RB_waitForData(DMA_RingBufferHandle_t * handle, uint32_t timeout){
     
     //first take semaphore
     if(xSemaphoreTake(handle->dataSemaphore, 0)){
-        //check if timeout is reasonable (if its too long we might get stuck if isr somehow isn't called) TODO: evaluate and make it reliable
-        if(timeout > 10000) timeout = 10000;
-        //try to take the semaphore
-        ret = xSemaphoreTake(handle->dataSemaphore, timeout);
+        //the half buffer interrupts might take a long time to come if data stops flowing, so never wait longer than the latency target before checking the buffer
+        while(timeout > 0){
+            uint32_t delay = timeout;
+            if(mode == DMA_RB_NOTIFY_HALF && delay > handle->latencyTarget) delay = handle->latencyTarget;
+            
+            //try to take the semaphore
+            if(xSemaphoreTake(handle->dataSemaphore, delay)){
+                //measure how long it took us to get going after the isr fired
+                uint32_t latency = xTaskGetTickCount() - handle->notifyTick;
+                handle->wakeLatency = (handle->wakeLatency * 3 + latency) / 4;
+                ret = 1;
+                break;
+            }
+            timeout -= delay;
+            
+            if(mode == DMA_RB_NOTIFY_HALF && DMA_RB_available(handle) > 0){
+                ret = 1;
+                break;
+            }
+        }
 
     }else; //damn we weren't even able to take it here, something was very wrong. Just reset to default state and return
     
     //disable irq
-    DMA_setInterruptConfig(handle->channelHandle, -1, -1, -1, -1, -1, 0, -1, -1);
+    DMA_RB_setNotifyIRQ(handle, mode, 0);
 
     //free the semaphore again (even if we didn't get it, just to make sure we won't get locked up)
     xSemaphoreGive(handle->dataSemaphore);
         
     return ret;
-}
\ No newline at end of file
+}
+
+static void DMA_RB_setNotifyIRQ(DMA_RingBufferHandle_t * handle, uint32_t mode, int32_t enabled){
+    if(mode == DMA_RB_NOTIFY_CELL){
+        //cursors might be waiting on the cell interrupt as well
+        DMA_RB_cellIRQRef(handle, enabled ? 1 : -1);
+    }else if(mode == DMA_RB_NOTIFY_HALF){
+        //with the destination spanning the whole buffer these fire at the middle and at the wraparound
+        DMA_setInterruptConfig(handle->channelHandle, -1, -1, enabled, enabled, -1, -1, -1, -1);
+    }
+}
+
+//estimates the data rate from how much the DMA moved since the last call. The main read position can't be used for that, it stays put on rings only read through cursors
+static void DMA_RB_updateRate(DMA_RingBufferHandle_t * handle){
+    TickType_t now = xTaskGetTickCount();
+    TickType_t elapsed = now - handle->rateLastTick;
+    if(elapsed == 0) return;
+    
+    uint32_t total = DMA_RB_getTransferTotal(handle);
+    uint32_t moved = total - handle->rateLastTotal;
+    
+    uint32_t sample = (uint32_t) (((uint64_t) moved * configTICK_RATE_HZ) / elapsed);
+    handle->dataRate = (handle->dataRate * 3 + sample) / 4;
+    
+    handle->rateLastTotal = total;
+    handle->rateLastTick = now;
+}
+
+//pick the notification mode with the lowest latency that still keeps us below the interrupt rate limit
+static uint32_t DMA_RB_selectNotifyMode(DMA_RingBufferHandle_t * handle){
+    //no limit or low enough rate? Then just take an interrupt per cell
+    if(handle->maxIrqRate == 0 || (handle->dataRate / handle->dataSize) <= handle->maxIrqRate) return DMA_RB_NOTIFY_CELL;
+    
+    //whatever time we need to wake up is lost from the latency budget
+    uint32_t budget = (handle->latencyTarget > handle->wakeLatency) ? handle->latencyTarget - handle->wakeLatency : 1;
+    
+    //half buffer interrupts are only an option if half a buffer fills up within the budget and they don't exceed the limit either
+    uint32_t halfSize = handle->bufferSize / 2;
+    uint32_t halfFillTicks = (handle->dataRate > 0) ? (halfSize * configTICK_RATE_HZ) / handle->dataRate : UINT32_MAX;
+    uint32_t halfIrqRate = (halfSize > 0) ? handle->dataRate / halfSize : UINT32_MAX;
+    if(halfFillTicks <= budget && halfIrqRate <= handle->maxIrqRate) return DMA_RB_NOTIFY_HALF;
+    
+    //otherwise polling every latencyTarget ticks is the only thing that meets both
+    return DMA_RB_NOTIFY_TIMEOUT;
+}
+
+//the cell done interrupt is shared by everybody waiting on the ring, only turn it off once the last one is done
+static void DMA_RB_cellIRQRef(DMA_RingBufferHandle_t * handle, int32_t ref){
+    taskENTER_CRITICAL();
+    
+    if(ref > 0){
+        if(handle->cellIRQUsers++ == 0) DMA_setInterruptConfig(handle->channelHandle, -1, -1, -1, -1, -1, 1, -1, -1);
+    }else if(handle->cellIRQUsers > 0){
+        if(--handle->cellIRQUsers == 0) DMA_setInterruptConfig(handle->channelHandle, -1, -1, -1, -1, -1, 0, -1, -1);
+    }
+    
+    taskEXIT_CRITICAL();
+}
+
+//total number of bytes the DMA has written since the ring was created (wraps at 2^32)
+static uint32_t DMA_RB_getWriteTotal(DMA_RingBufferHandle_t * handle){
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    uint32_t total = handle->wrapTotal + DMA_RB_getWritePos(handle);
+    
+    //the DMA already wrapped around but the isr didn't count it yet
+    if(handle->channelHandle->INT->w & _DCH0INT_CHBCIF_MASK) total += handle->bufferSize;
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    return total;
+}
+
+//data[0] holds stream position wrapTotal, anything before that is in the previous pass through the buffer
+static uint32_t DMA_RB_totalToIndex(DMA_RingBufferHandle_t * handle, uint32_t total){
+    uint32_t index = total - handle->wrapTotal;
+    if((int32_t) index < 0) index += handle->bufferSize;
+    if(index >= handle->bufferSize) index -= handle->bufferSize;
+    configASSERT(index < handle->bufferSize);
+    return index;
+}
+
+//the DMA is about to start over at the beginning of the buffer after dropping its data. Everything cursors didn't read yet counts as overrun
+//must be called with interrupts disabled or from the isr
+static void DMA_RB_restartStream(DMA_RingBufferHandle_t * handle){
+    uint32_t base = handle->wrapTotal + handle->lastWritePos;
+    
+    for(DMA_RB_Cursor_t * cursor = handle->cursors; cursor != NULL; cursor = cursor->next){
+        if((int32_t) (base - cursor->readTotal) > 0){
+            cursor->overrunBytes += base - cursor->readTotal;
+            cursor->overrunCount++;
+            cursor->readTotal = base;
+        }
+    }
+    
+    handle->wrapTotal = base;
+}
+
+//adds another reader to an RX ring. It starts at the current write position and reads independently of all other readers.
+//overrunThreshold is how far (in bytes) the cursor may fall behind the DMA before the data is considered lost, 0 = as far as the buffer allows
+DMA_RB_Cursor_t * DMA_RB_attachCursor(DMA_RingBufferHandle_t * handle, uint32_t overrunThreshold){
+    if(handle->direction != RINGBUFFER_DIRECTION_RX) return NULL;
+    
+    DMA_RB_Cursor_t * ret = pvPortMalloc(sizeof(DMA_RB_Cursor_t));
+    if(ret == NULL) return NULL;
+    
+    ret->dataSemaphore = xSemaphoreCreateBinary();
+    if(ret->dataSemaphore == NULL){
+        vPortFree(ret);
+        return NULL;
+    }
+    
+    //the newest cell might still be in flight when the reader gets to it, so it must never get closer than that to the write position
+    uint32_t maxThreshold = handle->bufferSize - handle->dataSize;
+    if(overrunThreshold == 0 || overrunThreshold > maxThreshold) overrunThreshold = maxThreshold;
+    
+    ret->ring = handle;
+    ret->overrunThreshold = overrunThreshold;
+    ret->overrunBytes = 0;
+    ret->overrunCount = 0;
+    ret->waiting = 0;
+    
+    taskENTER_CRITICAL();
+    ret->readTotal = DMA_RB_getWriteTotal(handle);
+    ret->ptrTotal = ret->readTotal;
+    ret->next = handle->cursors;
+    handle->cursors = ret;
+    taskEXIT_CRITICAL();
+    
+    return ret;
+}
+
+void DMA_RB_detachCursor(DMA_RB_Cursor_t * cursor){
+    if(cursor == NULL) return;
+    DMA_RingBufferHandle_t * handle = cursor->ring;
+    
+    taskENTER_CRITICAL();
+    DMA_RB_Cursor_t ** curr = &handle->cursors;
+    while(*curr != NULL && *curr != cursor) curr = &(*curr)->next;
+    if(*curr != NULL) *curr = cursor->next;
+    taskEXIT_CRITICAL();
+    
+    vSemaphoreDelete(cursor->dataSemaphore);
+    vPortFree(cursor);
+}
+
+//skips ahead if the cursor fell behind too far and returns how much it can read. start is where that data begins, taken in the same critical section
+//so a restart of the stream in between can't make the caller read from a position the count wasn't for
+static uint32_t DMA_RB_cursorCatchUp(DMA_RB_Cursor_t * cursor, uint32_t * start){
+    //the isr moves readTotal as well when the stream restarts, so the skip ahead must not get interrupted
+    taskENTER_CRITICAL();
+    uint32_t lag = DMA_RB_getWriteTotal(cursor->ring) - cursor->readTotal;
+    
+    if(lag > cursor->overrunThreshold){
+        //reader fell behind too far, the oldest data is (or is about to be) overwritten. Skip ahead and keep only the newest half of the buffer
+        uint32_t keep = cursor->ring->bufferSize / 2;
+        if(keep > cursor->overrunThreshold) keep = cursor->overrunThreshold;
+        
+        cursor->overrunBytes += lag - keep;
+        cursor->overrunCount++;
+        cursor->readTotal += lag - keep;
+        lag = keep;
+    }
+    *start = cursor->readTotal;
+    taskEXIT_CRITICAL();
+    
+    return lag;
+}
+
+uint32_t DMA_RB_cursorAvailable(DMA_RB_Cursor_t * cursor){
+    uint32_t start;
+    return DMA_RB_cursorCatchUp(cursor, &start);
+}
+
+//moves the cursor on by size bytes unless the isr moved it since start was read. In that case the data in between was dropped and whatever the caller read is stale.
+//The same goes for data the DMA got to again while the caller was still reading it, the next DMA_RB_cursorAvailable counts that as overrun
+static uint32_t DMA_RB_cursorCommit(DMA_RB_Cursor_t * cursor, uint32_t start, uint32_t size){
+    DMA_RingBufferHandle_t * handle = cursor->ring;
+    
+    taskENTER_CRITICAL();
+    uint32_t valid = (cursor->readTotal == start) && (DMA_RB_getWriteTotal(handle) - start <= handle->bufferSize - handle->dataSize);
+    if(valid){
+        cursor->readTotal = start + size;
+        cursor->ptrTotal = start + size;
+    }
+    taskEXIT_CRITICAL();
+    
+    return valid ? size : 0;
+}
+
+uint32_t DMA_RB_cursorRead(DMA_RB_Cursor_t * cursor, uint8_t * dst, uint32_t size){
+    DMA_RingBufferHandle_t * handle = cursor->ring;
+    
+    uint32_t start;
+    uint32_t available = DMA_RB_cursorCatchUp(cursor, &start);
+    if(size > available) size = available;
+    if(size == 0) return 0;
+    
+    //copy in (at most) two parts, the end of the buffer and then the start
+    uint32_t index = DMA_RB_totalToIndex(handle, start);
+    uint32_t first = handle->bufferSize - index;
+    if(first > size) first = size;
+    
+    memcpy(dst, &handle->data[index], first);
+    if(size > first) memcpy(&dst[first], handle->data, size - first);
+    
+    return DMA_RB_cursorCommit(cursor, start, size);
+}
+
+//zero copy access: returns how many bytes can be read in one go from *dst. Call DMA_RB_cursorAdvance once done with them
+uint32_t DMA_RB_cursorGetPtr(DMA_RB_Cursor_t * cursor, void ** dst){
+    DMA_RingBufferHandle_t * handle = cursor->ring;
+    
+    uint32_t start;
+    uint32_t available = DMA_RB_cursorCatchUp(cursor, &start);
+    cursor->ptrTotal = start;
+    if(available == 0) return 0;
+    
+    uint32_t index = DMA_RB_totalToIndex(handle, start);
+    *dst = &handle->data[index];
+    
+    if(available > handle->bufferSize - index) available = handle->bufferSize - index;
+    return available;
+}
+
+uint32_t DMA_RB_cursorAdvance(DMA_RB_Cursor_t * cursor, uint32_t size){
+    uint32_t start;
+    uint32_t available = DMA_RB_cursorCatchUp(cursor, &start);
+    if(size > available) size = available;
+    
+    //if the cursor had to skip ahead (or the stream restarted) the data behind the pointer from DMA_RB_cursorGetPtr is already gone
+    if(start != cursor->ptrTotal) return 0;
+    
+    return DMA_RB_cursorCommit(cursor, start, size);
+}
+
+uint32_t DMA_RB_cursorWait(DMA_RB_Cursor_t * cursor, uint32_t timeout){
+    DMA_RingBufferHandle_t * handle = cursor->ring;
+    
+    if(DMA_RB_cursorAvailable(cursor) > 0) return 1;
+    
+    //get rid of any stale notification, then check again in case data came in while we were doing that
+    xSemaphoreTake(cursor->dataSemaphore, 0);
+    cursor->waiting = 1;
+    DMA_RB_cellIRQRef(handle, 1);
+    
+    uint32_t ret = DMA_RB_cursorAvailable(cursor) > 0;
+    if(!ret){
+        if(timeout > 10000) timeout = 10000;
+        ret = xSemaphoreTake(cursor->dataSemaphore, timeout) || (DMA_RB_cursorAvailable(cursor) > 0);
+    }
+    
+    DMA_RB_cellIRQRef(handle, -1);
+    cursor->waiting = 0;
+    
+    return ret;
+}
+
+uint32_t DMA_RB_cursorGetOverrun(DMA_RB_Cursor_t * cursor){
+    return cursor->overrunBytes;
+}
+
+//total number of bytes the channel moved so far (wraps at 2^32): written into an RX ring or sent out of a TX ring. Lets others watch the throughput
+uint32_t DMA_RB_getTransferTotal(DMA_RingBufferHandle_t * handle){
+    if(handle->direction == RINGBUFFER_DIRECTION_RX) return DMA_RB_getWriteTotal(handle);
+    
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    //a finished chunk the isr didn't retire yet went out completely, the pointer of a running one tells how far it got
+    uint32_t total = handle->txSentTotal;
+    if(handle->txActive) total += (handle->channelHandle->INT->w & _DCH0INT_CHBCIF_MASK) ? handle->txActive : *(handle->channelHandle->SPTR);
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    return total;
+}
+
+//how far the slowest cursor lags behind the DMA, in bytes
+uint32_t DMA_RB_getSlowestLag(DMA_RingBufferHandle_t * handle){
+    uint32_t ret = 0;
+    uint32_t total = DMA_RB_getWriteTotal(handle);
+    
+    taskENTER_CRITICAL();
+    for(DMA_RB_Cursor_t * cursor = handle->cursors; cursor != NULL; cursor = cursor->next){
+        uint32_t lag = total - cursor->readTotal;
+        if(lag > ret) ret = lag;
+    }
+    taskEXIT_CRITICAL();
+    
+    return ret;
+}
@@ -0,0 +1,238 @@
+#include <xc.h>
+#include <stdint.h>
+#include <sys/kmem.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "DMA.h"
+#include "DMAvirtual.h"
+#include "DMAconfig.h"
+
+//a hardware channel as seen by the scheduler. The handle lives in here so channels can be claimed and released from ISRs without touching the heap
+typedef struct{
+    DmaHandle_t handle;
+    DMA_VirtualRequest_t * request;
+    uint32_t inUse;
+} DMA_VC_Slot_t;
+
+static DMA_VC_Slot_t DMA_VC_slots[DMA_VC_MAXCHANNELS];
+static DMA_VirtualRequest_t * DMA_VC_queue = NULL;
+
+static void DMA_VC_ISR(uint32_t evt, void * data);
+static void DMA_VC_arm(DMA_VC_Slot_t * slot, DMA_VirtualRequest_t * request);
+static void DMA_VC_finish(DMA_VC_Slot_t * slot, uint32_t evt, uint32_t bytes);
+static DMA_VirtualRequest_t * DMA_VC_pop();
+
+uint32_t DMA_VC_submit(DMA_VirtualRequest_t * request){
+    if(request == NULL) return 0;
+    if(request->prio > DMA_VC_PRIO_HIGHEST) request->prio = DMA_VC_PRIO_HIGHEST;
+    
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    //request is still in flight? Don't touch it
+    if((request->state == DMA_VC_STATE_QUEUED) || (request->state == DMA_VC_STATE_ACTIVE)){
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        return 0;
+    }
+    
+    request->state = DMA_VC_STATE_QUEUED;
+    request->lastEvt = 0;
+    request->bytesTransferred = 0;
+    request->channelHandle = NULL;
+    
+    //insert behind all requests of the same or higher priority, so requests of one priority run in the order they were submitted
+    DMA_VirtualRequest_t ** curr = &DMA_VC_queue;
+    while(*curr != NULL && (*curr)->prio >= request->prio) curr = &(*curr)->next;
+    request->next = *curr;
+    *curr = request;
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    //try to get it onto a channel right away
+    DMA_VC_schedule();
+    
+    return 1;
+}
+
+uint32_t DMA_VC_cancel(DMA_VirtualRequest_t * request){
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    if(request->state == DMA_VC_STATE_QUEUED){
+        //not started yet, just unlink it
+        DMA_VirtualRequest_t ** curr = &DMA_VC_queue;
+        while(*curr != NULL && *curr != request) curr = &(*curr)->next;
+        if(*curr != NULL) *curr = request->next;
+        
+        request->next = NULL;
+        request->state = DMA_VC_STATE_IDLE;
+        
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        return 1;
+    }
+    
+    if(request->state == DMA_VC_STATE_ACTIVE){
+        //find the channel it is running on
+        for(uint32_t i = 0; i < DMA_VC_MAXCHANNELS; i++){
+            if(DMA_VC_slots[i].request != request) continue;
+            
+            DmaHandle_t * handle = &DMA_VC_slots[i].handle;
+            uint32_t bytes = DMA_getSourcePointerValue(handle);
+            if(DMA_getDestinationPointerValue(handle) > bytes) bytes = DMA_getDestinationPointerValue(handle);
+            
+            //stop the channel and clear its flags so the ISR won't complete the request a second time
+            DMA_abortTransfer(handle);
+            DMA_clearIF(handle, 0xff);
+            
+            taskEXIT_CRITICAL_FROM_ISR(irqState);
+            
+            DMA_VC_finish(&DMA_VC_slots[i], _DCH0INT_CHTAIF_MASK, bytes);
+            return 1;
+        }
+    }
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    return 0;
+}
+
+//maps queued requests onto free hardware channels. Called on every submit and completion, can be called from an ISR
+void DMA_VC_schedule(){
+    while(1){
+        UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+        
+        //anything to do?
+        if(DMA_VC_queue == NULL){
+            taskEXIT_CRITICAL_FROM_ISR(irqState);
+            return;
+        }
+        
+        //find a slot we can put a hardware channel into
+        DMA_VC_Slot_t * slot = NULL;
+        for(uint32_t i = 0; i < DMA_VC_MAXCHANNELS; i++){
+            if(!DMA_VC_slots[i].inUse){
+                slot = &DMA_VC_slots[i];
+                break;
+            }
+        }
+        
+        //no slot or no hardware channel left => the request stays queued until something completes or a channel gets freed
+        if(slot == NULL || !DMA_claimChannel(&slot->handle)){
+            taskEXIT_CRITICAL_FROM_ISR(irqState);
+            return;
+        }
+        
+        slot->inUse = 1;
+        DMA_VirtualRequest_t * request = DMA_VC_pop();
+        slot->request = request;
+        
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        
+        DMA_VC_arm(slot, request);
+    }
+}
+
+uint32_t DMA_VC_getQueueLength(){
+    uint32_t ret = 0;
+    
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    for(DMA_VirtualRequest_t * curr = DMA_VC_queue; curr != NULL; curr = curr->next) ret++;
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    return ret;
+}
+
+uint32_t DMA_VC_getActiveCount(){
+    uint32_t ret = 0;
+    for(uint32_t i = 0; i < DMA_VC_MAXCHANNELS; i++){
+        if(DMA_VC_slots[i].inUse) ret++;
+    }
+    return ret;
+}
+
+//must be called with the scheduler lock held
+static DMA_VirtualRequest_t * DMA_VC_pop(){
+    DMA_VirtualRequest_t * ret = DMA_VC_queue;
+    if(ret != NULL){
+        DMA_VC_queue = ret->next;
+        ret->next = NULL;
+    }
+    return ret;
+}
+
+static void DMA_VC_arm(DMA_VC_Slot_t * slot, DMA_VirtualRequest_t * request){
+    DmaHandle_t * handle = &slot->handle;
+    
+    request->channelHandle = handle;
+    request->state = DMA_VC_STATE_ACTIVE;
+    
+    DMA_setIRQHandler(handle, DMA_VC_ISR, slot);
+    DMA_setChannelAttributes(handle, 0, 0, 0, 0, request->prio);
+    DMA_setTransferAttributes(handle, request->cellSize, request->startIRQ, request->abortIRQ);
+    DMA_setSrcConfig(handle, request->src, request->srcSize);
+    DMA_setDestConfig(handle, request->dst, request->dstSize);
+    
+    //we only care about the end of the transfer, one way or the other
+    DMA_setInterruptConfig(handle, 0, 0, 0, 0, 1, 0, 1, 1);
+    DMA_setIRQEnabled(handle, 1);
+    
+    DMA_setEnabled(handle, 1);
+    
+    //no trigger configured => memory to memory, kick it off ourselves
+    if(request->startIRQ == -1) DMA_forceTransfer(handle);
+}
+
+static void DMA_VC_finish(DMA_VC_Slot_t * slot, uint32_t evt, uint32_t bytes){
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    DMA_VirtualRequest_t * request = slot->request;
+    if(request == NULL){
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        return;
+    }
+    slot->request = NULL;
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    request->lastEvt = evt;
+    request->bytesTransferred = bytes;
+    request->channelHandle = NULL;
+    request->state = DMA_VC_STATE_DONE;
+    
+    //the handle still describes the finished transfer at this point, it gets reused or released right after
+    if(request->handler != NULL) request->handler(&slot->handle, evt, bytes, request->data);
+    
+    //got more work? Then keep the channel and start the next request on it right away
+    irqState = taskENTER_CRITICAL_FROM_ISR();
+    DMA_VirtualRequest_t * next = DMA_VC_pop();
+    slot->request = next;
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    if(next != NULL){
+        DMA_VC_arm(slot, next);
+        return;
+    }
+    
+    //nothing queued, give the hardware channel back
+    DMA_releaseChannel(&slot->handle);
+    slot->inUse = 0;
+    
+    //something might have been submitted while we were releasing the channel
+    DMA_VC_schedule();
+}
+
+static void DMA_VC_ISR(uint32_t evt, void * data){
+    DMA_VC_Slot_t * slot = (DMA_VC_Slot_t *) data;
+    DmaHandle_t * handle = &slot->handle;
+    
+    if(!(evt & (_DCH0INT_CHBCIF_MASK | _DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK))) return;
+    
+    uint32_t bytes;
+    if(evt & _DCH0INT_CHBCIF_MASK){
+        //block completed, a block is as long as the larger of the two sizes
+        bytes = (DCHSSIZ > DCHDSIZ) ? DCHSSIZ : DCHDSIZ;
+    }else{
+        bytes = DMA_getSourcePointerValue(handle);
+        if(DMA_getDestinationPointerValue(handle) > bytes) bytes = DMA_getDestinationPointerValue(handle);
+    }
+    
+    DMA_VC_finish(slot, evt, bytes);
+}
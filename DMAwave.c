@@ -0,0 +1,250 @@
+#include <xc.h>
+#include <stdint.h>
+#include <sys/kmem.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "DMA.h"
+#include "DMAwave.h"
+#include "DMAconfig.h"
+
+static void DMA_WAVE_ISR0(uint32_t evt, void * data);
+static void DMA_WAVE_ISR1(uint32_t evt, void * data);
+static void DMA_WAVE_handleEvent(DMA_WaveHandle_t * handle, uint32_t index, uint32_t evt);
+static void DMA_WAVE_load(DMA_WaveHandle_t * handle, uint32_t index, const uint8_t * table, uint32_t length);
+static void DMA_WAVE_halt(DMA_WaveHandle_t * handle);
+
+DMA_WaveHandle_t * DMA_createWave(volatile void * dst, uint32_t cellSize, uint32_t triggerIRQ, uint32_t prio){
+    if(cellSize == 0 || cellSize > 4) return NULL;
+    
+    DMA_WaveHandle_t * ret = pvPortMalloc(sizeof(DMA_WaveHandle_t));
+    if(ret == NULL) return NULL;
+    
+    ret->dst = dst;
+    ret->cellSize = cellSize;
+    ret->triggerIRQ = triggerIRQ;
+    ret->flags = 0;
+    ret->running = 0;
+    
+    ret->channelTable[0] = NULL;
+    ret->channelTable[1] = NULL;
+    ret->table = NULL;
+    ret->length = 0;
+    ret->loadedTable = NULL;
+    ret->loadedLength = 0;
+    ret->nextTable = NULL;
+    ret->nextLength = 0;
+    
+    ret->wraps = 0;
+    ret->underruns = 0;
+    ret->lateSwaps = 0;
+    
+    ret->handler = NULL;
+    ret->handlerData = NULL;
+    
+    //chaining only works between neighbouring channels
+    if(!DMA_allocateChannelPair(&ret->channels[0], &ret->channels[1])){
+        vPortFree(ret);
+        return NULL;
+    }
+    
+    for(uint32_t i = 0; i < 2; i++){
+        DmaHandle_t * channel = ret->channels[i];
+        
+        //the lower channel gets started by the higher one and the other way round. No auto enable, each channel plays one pass and then hands over
+        DMA_setIRQHandler(channel, (i == 0) ? DMA_WAVE_ISR0 : DMA_WAVE_ISR1, ret);
+        DMA_setChannelAttributes(channel, 1, (i == 0), 0, 0, prio);
+        DMA_setInterruptConfig(channel, 0, 0, 0, 0, 1, 0, 1, 1);
+        DMA_setTransferAttributes(channel, cellSize, triggerIRQ, -1);
+        DMA_setDestConfig(channel, (uint32_t *) dst, cellSize);
+        DMA_setIRQEnabled(channel, 1);
+    }
+    
+    return ret;
+}
+
+void DMA_freeWave(DMA_WaveHandle_t * handle){
+    if(handle == NULL) return;
+    
+    DMA_WAVE_stop(handle);
+    DMA_freeChannel(handle->channels[0]);
+    DMA_freeChannel(handle->channels[1]);
+    vPortFree(handle);
+}
+
+uint32_t DMA_WAVE_setSwapHandler(DMA_WaveHandle_t * handle, DMACompletionHandler_t handler, void * data){
+    handle->handler = handler;
+    handle->handlerData = data;
+    return 1;
+}
+
+uint32_t DMA_WAVE_start(DMA_WaveHandle_t * handle, const uint8_t * table, uint32_t length, uint32_t flags){
+    if(table == NULL || length == 0 || length > DMA_MAXBLOCKSIZE || (length % handle->cellSize) != 0) return 0;
+    
+    DMA_WAVE_stop(handle);
+    
+    handle->table = table;
+    handle->length = length;
+    handle->loadedTable = NULL;
+    handle->nextTable = NULL;
+    handle->flags = flags;
+    
+    handle->wraps = 0;
+    handle->underruns = 0;
+    handle->lateSwaps = 0;
+    
+    //both channels play the table until something else gets queued
+    DMA_WAVE_load(handle, 0, table, length);
+    DMA_WAVE_load(handle, 1, table, length);
+    
+    handle->running = 1;
+    DMA_setEnabled(handle->channels[0], 1);
+    
+    return 1;
+}
+
+uint32_t DMA_WAVE_stop(DMA_WaveHandle_t * handle){
+    if(!handle->running) return 0;
+    
+    taskENTER_CRITICAL();
+    DMA_WAVE_halt(handle);
+    taskEXIT_CRITICAL();
+    
+    //both channels are off now, so the chaining can be turned back on for the next start
+    DMA_setChannelAttributes(handle->channels[0], 1, -1, -1, -1, -1);
+    DMA_setChannelAttributes(handle->channels[1], 1, -1, -1, -1, -1);
+    
+    return 1;
+}
+
+//the table takes over once the current pass ends, so the waveform stays continuous. If there is already a table waiting for its turn
+//this one replaces whatever is queued behind it
+uint32_t DMA_WAVE_queueTable(DMA_WaveHandle_t * handle, const uint8_t * table, uint32_t length){
+    if(!handle->running) return 0;
+    if(table == NULL || length == 0 || length > DMA_MAXBLOCKSIZE || (length % handle->cellSize) != 0) return 0;
+    
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    uint32_t idle = DMA_isEnabled(handle->channels[0]) ? 1 : 0;
+    if(handle->loadedTable == NULL && !DMA_isEnabled(handle->channels[idle])){
+        //the idle channel plays next, give it the new table right away. Should the running pass end just now the chain enables the channel with
+        //the new table in it before the next trigger comes, which is just as fine
+        DMA_WAVE_load(handle, idle, table, length);
+        handle->loadedTable = table;
+        handle->loadedLength = length;
+    }else{
+        handle->nextTable = table;
+        handle->nextLength = length;
+    }
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    return 1;
+}
+
+//index of the next sample (in cells) that goes out of the current table
+uint32_t DMA_WAVE_getPosition(DMA_WaveHandle_t * handle){
+    for(uint32_t i = 0; i < 2; i++){
+        if(DMA_isEnabled(handle->channels[i])) return DMA_getSourcePointerValue(handle->channels[i]) / handle->cellSize;
+    }
+    return 0;
+}
+
+uint32_t DMA_WAVE_getWrapCount(DMA_WaveHandle_t * handle){
+    return handle->wraps;
+}
+
+uint32_t DMA_WAVE_getUnderruns(DMA_WaveHandle_t * handle){
+    return handle->underruns;
+}
+
+uint32_t DMA_WAVE_getLateSwaps(DMA_WaveHandle_t * handle){
+    return handle->lateSwaps;
+}
+
+//must be called with the channel disabled or from within the chain handover (see DMA_WAVE_queueTable)
+static void DMA_WAVE_load(DMA_WaveHandle_t * handle, uint32_t index, const uint8_t * table, uint32_t length){
+    DMA_setSrcConfig(handle->channels[index], (uint32_t *) table, length);
+    handle->channelTable[index] = table;
+    handle->channelLength[index] = length;
+}
+
+//stops both channels. Must be called with interrupts disabled or from the isr
+static void DMA_WAVE_halt(DMA_WaveHandle_t * handle){
+    handle->running = 0;
+    
+    //unchain first so stopping one channel can't start the other. Through the CLR register, a read-modify-write could turn a channel back on that just finished
+    *(handle->channels[0]->CONCLR) = _DCH0CON_CHCHN_MASK;
+    *(handle->channels[1]->CONCLR) = _DCH0CON_CHCHN_MASK;
+    
+    for(uint32_t i = 0; i < 2; i++){
+        DMA_abortTransfer(handle->channels[i]);
+        DMA_clearIF(handle->channels[i], 0xff);
+    }
+    
+    handle->loadedTable = NULL;
+    handle->nextTable = NULL;
+}
+
+static void DMA_WAVE_ISR0(uint32_t evt, void * data){
+    DMA_WAVE_handleEvent((DMA_WaveHandle_t *) data, 0, evt);
+}
+
+static void DMA_WAVE_ISR1(uint32_t evt, void * data){
+    DMA_WAVE_handleEvent((DMA_WaveHandle_t *) data, 1, evt);
+}
+
+static void DMA_WAVE_handleEvent(DMA_WaveHandle_t * handle, uint32_t index, uint32_t evt){
+    if(!handle->running) return;
+    
+    if(evt & (_DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK)){
+        //nothing we can do about it, playback is over
+        UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+        DMA_WAVE_halt(handle);
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        return;
+    }
+    
+    if(!(evt & _DCH0INT_CHBCIF_MASK)) return;
+    
+    //channel index just finished its pass and the chain started the other one
+    uint32_t other = index ^ 1;
+    uint32_t swapped = 0;
+    
+    UBaseType_t irqState = taskENTER_CRITICAL_FROM_ISR();
+    
+    handle->wraps++;
+    
+    if(DMA_isEnabled(handle->channels[index])){
+        //the other channel is already done as well and started this one again, so we're more than a whole pass late.
+        //Nothing can be changed on a running channel, the interrupt of the other one will sort things out
+        handle->lateSwaps++;
+        taskEXIT_CRITICAL_FROM_ISR(irqState);
+        return;
+    }
+    
+    if(handle->loadedTable != NULL && handle->channelTable[other] == handle->loadedTable){
+        //the queued table is playing now
+        handle->table = handle->loadedTable;
+        handle->length = handle->loadedLength;
+        handle->loadedTable = NULL;
+        swapped = 1;
+    }else if(handle->flags & DMA_WAVE_FLAG_STREAM){
+        handle->underruns++;
+    }
+    
+    if(handle->loadedTable == NULL && handle->nextTable != NULL){
+        handle->loadedTable = handle->nextTable;
+        handle->loadedLength = handle->nextLength;
+        handle->nextTable = NULL;
+    }
+    
+    //this channel plays after the other one. Give it the queued table if there is one, otherwise the current one so the previous table isn't used anymore
+    const uint8_t * table = (handle->loadedTable != NULL) ? handle->loadedTable : handle->table;
+    uint32_t length = (handle->loadedTable != NULL) ? handle->loadedLength : handle->length;
+    if(handle->channelTable[index] != table) DMA_WAVE_load(handle, index, table, length);
+    
+    taskEXIT_CRITICAL_FROM_ISR(irqState);
+    
+    if(swapped && handle->handler != NULL) handle->handler(handle->channels[other], evt, handle->length, handle->handlerData);
+}
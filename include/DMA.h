@@ -4,6 +4,48 @@
 #include <xc.h>
 #include "DMAconfig.h"
 
+//set to 1 in DMAconfig.h to let DMA_freeChannel hand freed channels over to the virtual channel scheduler (DMAvirtual.h)
+#ifndef DMA_USE_VIRTUAL_CHANNELS
+#define DMA_USE_VIRTUAL_CHANNELS 0
+#endif
+
+//set to 1 in DMAconfig.h to allow channels to defer their handlers from the ISR into the DMA event task
+#ifndef DMA_USE_DEFERRED_EVENTS
+#define DMA_USE_DEFERRED_EVENTS 0
+#endif
+
+//must be a power of two
+#ifndef DMA_EVENTQUEUE_SIZE
+#define DMA_EVENTQUEUE_SIZE 32
+#endif
+
+//largest block a single channel can move in one go, SSIZ/DSIZ/CSIZ are 16 bits wide
+#ifndef DMA_MAXBLOCKSIZE
+#define DMA_MAXBLOCKSIZE 65535
+#endif
+
+//bitmask of channels that are assigned at compile time (see DMAstatic.h). These are never handed out by DMA_allocateChannel and DMA.c doesn't define their ISRs
+#ifndef DMA_STATIC_CHANNELS
+#define DMA_STATIC_CHANNELS 0
+#endif
+
+#define DMA_IS_STATIC(ch) ((DMA_STATIC_CHANNELS >> (ch)) & 1)
+
+//register that holds the interrupt enable bit of a channel, ch must be a literal number. Channels 4-7 live in IEC4
+#define DMA_IECREG(ch) DMA_IECREG_CH##ch
+#define DMA_IECREG_CH0 DMA_IEC
+#define DMA_IECREG_CH1 DMA_IEC
+#define DMA_IECREG_CH2 DMA_IEC
+#define DMA_IECREG_CH3 DMA_IEC
+#define DMA_IECREG_CH4 IEC4
+#define DMA_IECREG_CH5 IEC4
+#define DMA_IECREG_CH6 IEC4
+#define DMA_IECREG_CH7 IEC4
+
+#ifndef DMA_EVENTTASK_STACKSIZE
+#define DMA_EVENTTASK_STACKSIZE configMINIMAL_STACK_SIZE
+#endif
+
 #define DMA_IRQ_DISABLED -1
 #define DMA_ALL_IF _DCH0INT_CHSHIF_MASK | _DCH0INT_CHSHIF_MASK | _DCH0INT_CHDDIF_MASK | _DCH0INT_CHDHIF_MASK | _DCH0INT_CHBCIF_MASK | _DCH0INT_CHCCIF_MASK | _DCH0INT_CHTAIF_MASK | _DCH0INT_CHERIF_MASK
 
@@ -11,12 +53,23 @@ typedef volatile struct __DMA_Descriptor__ DmaHandle_t;
 //TODO refactor to also pass along the dma handle
 typedef void (* DMAIRQHandler_t)(uint32_t evt, void * data);
 
+//completion callback used by the transfer modules (virtual channels, async, 2D, duplex, wave). bytes is the number of bytes the channel moved
+typedef void (* DMACompletionHandler_t)(DmaHandle_t * handle, uint32_t evt, uint32_t bytes, void * data);
+
 typedef struct{
     DMAIRQHandler_t    handler;
     void            *  data;
     DmaHandle_t    *  handle;
+    uint32_t          deferred;
+    uint32_t          pinned;
 } DMAISR_t;
 
+typedef struct{
+    uint32_t channel;
+    uint32_t evt;
+    uint32_t timestamp;
+} DMA_Event_t;
+
 uint32_t DMA_setIRQHandler(DmaHandle_t * handle, DMAIRQHandler_t handlerFunction, void * data);
 uint32_t DMA_setIRQEnabled(DmaHandle_t * handle, int32_t enabled);
 
@@ -30,10 +83,38 @@ uint32_t DMA_setInterruptConfig(DmaHandle_t * handle, int32_t srcDoneEN, int32_t
 
 DmaHandle_t * DMA_allocateChannel();
 uint32_t DMA_freeChannel(DmaHandle_t * handle);
+uint32_t DMA_allocateChannelPair(DmaHandle_t ** low, DmaHandle_t ** high);
+
+//heap free versions of allocate/free, these populate/release a handle owned by the caller and are safe to call from an ISR
+uint32_t DMA_claimChannel(DmaHandle_t * handle);
+void DMA_releaseChannel(DmaHandle_t * handle);
+
+#if DMA_USE_DEFERRED_EVENTS
+//deferred handlers are called from the event task instead of the ISR. They still get the same arguments, the core timer value of the interrupt can be read with DMA_getEventTimestamp
+//they run in task context then, see DMA_inISR below
+uint32_t DMA_setIRQDeferred(DmaHandle_t * handle, uint32_t deferred);
+uint32_t DMA_startEventTask(uint32_t priority);
+uint32_t DMA_getEventTimestamp();
+uint32_t DMA_getEventQueueOverflows();
+//keeps the handler of a channel in the ISR until the channel is freed, DMA_setIRQDeferred fails for it after that. For handlers that look at
+//the flags still pending in the INT register, the ISR clears them before an event is queued so a deferred handler would never see them
+uint32_t DMA_pinIRQ(DmaHandle_t * handle);
+#else
+#define DMA_pinIRQ(handle)
+#endif
 
 void DMA_suspendAllTransfers();
 void DMA_resumeTransfers();
 
+//handlers run in the DMA ISR, in the event task for deferred channels or in the task that cancels/aborts a transfer. DMA_inISR tells them which one it is,
+//FromISR functions and portEND_SWITCHING_ISR must only be used if it returns 1. The helpers below pick the right call on their own
+extern volatile uint32_t DMA_isrNesting;
+#define DMA_inISR() (DMA_isrNesting != 0)
+
+#define DMA_semaphoreGiveFromHandler(sem, woken) do{ if(DMA_inISR()) xSemaphoreGiveFromISR(sem, woken); else xSemaphoreGive(sem); }while(0)
+#define DMA_yieldFromHandler(woken) do{ if(DMA_inISR()) portEND_SWITCHING_ISR(woken); }while(0)
+#define DMA_getTickCountFromHandler() (DMA_inISR() ? xTaskGetTickCountFromISR() : xTaskGetTickCount())
+
 #define DCHCON  handle->CON->w
 #define DCHCONbits (*handle->CON)
 #define DCHECON handle->ECON->w
@@ -42,6 +123,7 @@ void DMA_resumeTransfers();
 #define DCHINT  handle->INT->w
 #define DCHINTbits (*handle->INT)
 #define DCHINTCLR  *(handle->INTCLR)
+#define DCHINTSET  *(handle->INTSET)
 
 #define DCHSSA  *(handle->SSA)
 #define DCHDSA  *(handle->DSA)
@@ -78,6 +160,9 @@ void DMA_resumeTransfers();
 #define DMA_forceTransfer(handle) *(handle->ECONSET) = _DCH0ECON_CFORCE_MASK
 #define DMA_abortTransfer(handle) *(handle->ECONSET) = _DCH0ECON_CABORT_MASK
 
+//only touches CHPRI through the CLR/SET registers, so it's safe on a running channel. A read-modify-write of CON could write back a CHEN the hardware just cleared
+#define DMA_setPriority(handle, prio) do{ *(handle->CONCLR) = _DCH0CON_CHPRI_MASK; *(handle->CONSET) = ((prio) << _DCH0CON_CHPRI_POSITION) & _DCH0CON_CHPRI_MASK; }while(0)
+
 typedef union {
     struct {
       uint32_t CHPRI:2;
@@ -145,10 +230,13 @@ typedef union {
 
 struct __DMA_Descriptor__{
     volatile DCHxCON_t  *   CON;
+    volatile uint32_t   *   CONCLR;
+    volatile uint32_t   *   CONSET;
     volatile DCHxECON_t *   ECON;
     volatile uint32_t   *   ECONSET;
     volatile DCHxINT_t  *   INT;
     volatile uint32_t   *   INTCLR;
+    volatile uint32_t   *   INTSET;
     
     volatile uint32_t   *   volatile SSA;
     volatile uint32_t   *   volatile DSA;
@@ -0,0 +1,54 @@
+#ifndef DMA2D_INC
+#define DMA2D_INC
+
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "DMA.h"
+#include "DMAconfig.h"
+
+//describes a rectangle. Width is in bytes, strides are the distance in bytes between the start of two rows
+//a stride of 0 keeps the address fixed, which is what you want for a peripheral register
+typedef struct{
+    uint8_t * src;
+    uint8_t * dst;
+    
+    uint32_t width;
+    uint32_t height;
+    uint32_t srcStride;
+    uint32_t dstStride;
+    
+    //cell size and trigger of each row transfer, cellSize must not be larger than width. If startIRQ is -1 every row is moved in a single forced cell and cellSize is ignored
+    uint32_t cellSize;
+    int32_t startIRQ;
+} DMA_2DTransfer_t;
+
+typedef struct __DMA_2D_Descriptor__ DMA_2DHandle_t;
+
+DMA_2DHandle_t * DMA_create2D(uint32_t prio);
+void DMA_free2D(DMA_2DHandle_t * handle);
+
+uint32_t DMA_2D_start(DMA_2DHandle_t * handle, const DMA_2DTransfer_t * transfer);
+uint32_t DMA_2D_wait(DMA_2DHandle_t * handle, uint32_t timeout);
+uint32_t DMA_2D_abort(DMA_2DHandle_t * handle);
+uint32_t DMA_2D_setCompletionHandler(DMA_2DHandle_t * handle, DMACompletionHandler_t handler, void * data);
+
+#define DMA_2D_isBusy(handle) ((handle)->currentRow < (handle)->transfer.height)
+
+struct __DMA_2D_Descriptor__{
+    DmaHandle_t * channelHandle;
+    
+    DMA_2DTransfer_t transfer;
+    volatile uint32_t currentRow;
+    volatile uint32_t lastEvt;
+    uint32_t bytesTransferred;
+    
+    DMACompletionHandler_t handler;
+    void * handlerData;
+    
+    SemaphoreHandle_t doneSemaphore;
+};
+
+#endif
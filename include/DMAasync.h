@@ -0,0 +1,35 @@
+#ifndef DMAASYNC_INC
+#define DMAASYNC_INC
+
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "event_groups.h"
+#include "DMA.h"
+#include "DMAvirtual.h"
+#include "DMAconfig.h"
+
+//completion is signalled through an event group (one bit per token) set from the DMA ISR, so this needs configUSE_TIMERS and INCLUDE_xTimerPendFunctionCall
+#ifndef DMA_ASYNC_MAXTOKENS
+#define DMA_ASYNC_MAXTOKENS 16
+#endif
+
+#if DMA_ASYNC_MAXTOKENS > 24
+#error DMA_ASYNC_MAXTOKENS must not be larger than the number of usable event group bits (24)
+#endif
+
+typedef uint32_t DMA_Token_t;
+
+#define DMA_TOKEN_INVALID 0
+
+//every token returned by DMA_submit must eventually be consumed by one of the wait functions or by DMA_cancel
+DMA_Token_t DMA_submit(void * src, uint32_t srcSize, void * dst, uint32_t dstSize, uint32_t cellSize, int32_t startIRQ, uint32_t prio, DMACompletionHandler_t callback, void * data);
+uint32_t DMA_cancel(DMA_Token_t token);
+
+uint32_t DMA_isDone(DMA_Token_t token);
+uint32_t DMA_wait(DMA_Token_t token, uint32_t timeout, uint32_t * bytes);
+int32_t DMA_waitAny(DMA_Token_t * tokens, uint32_t count, uint32_t timeout);
+uint32_t DMA_waitAll(DMA_Token_t * tokens, uint32_t count, uint32_t timeout);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef DMACRC_INC
+#define DMACRC_INC
+
+#include <stdint.h>
+
+//anything not built with xc32 (host side tests, tools) only gets the software implementation
+#if !defined(__XC32) && !defined(DMA_CRC_SOFTWARE_ONLY)
+#define DMA_CRC_SOFTWARE_ONLY
+#endif
+
+#ifndef DMA_CRC_SOFTWARE_ONLY
+#include <xc.h>
+#include "DMA.h"
+#include "DMAconfig.h"
+#endif
+
+#define DMA_CRC_MODE_BACKGROUND 0   //data is copied from source to destination as usual, crc is calculated on the way
+#define DMA_CRC_MODE_APPEND     1   //data is only fed into the crc, at the end of the block the crc is written to the destination
+
+//the hardware engine only supports up to 16 bit polynomials on some older PIC32MX parts, 32 bits everywhere else
+typedef struct{
+    uint32_t polynomial;    //normal (msb first) notation without the implicit x^width term, e.g. 0x04C11DB7 for crc32
+    uint32_t width;         //1 ... 32 bits
+    uint32_t seed;          //initial crc value, given in the same bit order as the result
+    uint32_t reflected;     //1 = data is processed lsb first (BITO), result is reflected as well
+    uint32_t finalXor;      //applied to the result, the hardware doesn't do this so it is done when reading the result
+    
+    const uint32_t * table; //optional 256 entry table created with DMA_CRC_initTable, the software implementation falls back to bitwise calculation if NULL
+} DMA_CrcConfig_t;
+
+void DMA_CRC_initTable(const DMA_CrcConfig_t * cfg, uint32_t * table);
+uint32_t DMA_CRC_computeSW(const DMA_CrcConfig_t * cfg, const uint8_t * data, uint32_t length);
+uint32_t DMA_CRC_updateSW(const DMA_CrcConfig_t * cfg, uint32_t crc, const uint8_t * data, uint32_t length);
+
+//crcs a buffer via a DMA channel, or in software if this is a software only build. data must be coherent (kseg1) when the DMA is used
+//only the software path is checked against the reference check values. How the engine treats the seed and bit order may differ between parts, use DMA_CRC_verify to make sure a configuration gives the same result on the device
+uint32_t DMA_CRC_compute(const DMA_CrcConfig_t * cfg, const uint8_t * data, uint32_t length, uint32_t timeout, uint32_t * result);
+
+#ifndef DMA_CRC_SOFTWARE_ONLY
+//there is only one crc engine per DMA controller, attach returns 0 if it is already attached to another channel
+uint32_t DMA_CRC_attach(DmaHandle_t * handle, const DMA_CrcConfig_t * cfg, uint32_t mode);
+uint32_t DMA_CRC_detach(DmaHandle_t * handle);
+uint32_t DMA_CRC_getResult(const DMA_CrcConfig_t * cfg);
+uint32_t DMA_CRC_verify(const DMA_CrcConfig_t * cfg, uint32_t timeout);
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef DMADUPLEX_INC
+#define DMADUPLEX_INC
+
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "DMA.h"
+#include "DMAconfig.h"
+
+//size of the fill and discard buffers used when a transaction has no tx or rx data. Transactions without either get moved in chunks of this size
+#ifndef DMA_DUPLEX_SCRATCHSIZE
+#define DMA_DUPLEX_SCRATCHSIZE 32
+#endif
+
+#define DMA_DPX_STATE_IDLE      0
+#define DMA_DPX_STATE_QUEUED    1
+#define DMA_DPX_STATE_ACTIVE    2
+#define DMA_DPX_STATE_DONE      3
+
+typedef struct __DMA_DuplexTransaction__ DMA_DuplexTransaction_t;
+typedef struct __DMA_Duplex_Descriptor__ DMA_DuplexHandle_t;
+
+//one full duplex transfer, length bytes get sent and received at the same time. Memory is owned by the caller and must stay valid until the transaction is done
+//several transactions can be linked through next and submitted in one go
+struct __DMA_DuplexTransaction__{
+    DMA_DuplexTransaction_t * next;
+    
+    const uint8_t * txData;     //NULL = send txFill for every cell
+    uint8_t * rxData;           //NULL = throw the received data away
+    uint32_t length;            //must be a multiple of the cell size
+    uint32_t txFill;
+    
+    //called from the isr once this transaction is done, optional
+    DMACompletionHandler_t handler;
+    void * data;
+    
+    volatile uint32_t state;
+    volatile uint32_t lastEvt;
+    volatile uint32_t bytesTransferred;
+};
+
+DMA_DuplexHandle_t * DMA_createDuplex(volatile void * txReg, volatile void * rxReg, uint32_t cellSize, uint32_t txIRQ, uint32_t rxIRQ, uint32_t prio);
+uint32_t DMA_DPX_init(DMA_DuplexHandle_t * handle, DmaHandle_t * txChannel, DmaHandle_t * rxChannel, volatile void * txReg, volatile void * rxReg, uint32_t cellSize, uint32_t txIRQ, uint32_t rxIRQ, uint32_t prio);
+void DMA_freeDuplex(DMA_DuplexHandle_t * handle);
+
+uint32_t DMA_DPX_submit(DMA_DuplexHandle_t * handle, DMA_DuplexTransaction_t * transactions);
+uint32_t DMA_DPX_wait(DMA_DuplexHandle_t * handle, uint32_t timeout);
+uint32_t DMA_DPX_abort(DMA_DuplexHandle_t * handle);
+uint32_t DMA_DPX_transfer(DMA_DuplexHandle_t * handle, const uint8_t * txData, uint8_t * rxData, uint32_t length, uint32_t timeout);
+
+#define DMA_DPX_isBusy(handle) ((handle)->current != NULL)
+#define DMA_DPX_isDone(transaction) ((transaction)->state == DMA_DPX_STATE_DONE)
+#define DMA_DPX_succeeded(transaction) (DMA_DPX_isDone(transaction) && ((transaction)->lastEvt & _DCH0INT_CHBCIF_MASK))
+
+struct __DMA_Duplex_Descriptor__{
+    DmaHandle_t * txChannel;
+    DmaHandle_t * rxChannel;
+    
+    volatile void * txReg;
+    volatile void * rxReg;
+    uint32_t cellSize;
+    
+    //transaction being moved right now and the ones waiting behind it
+    DMA_DuplexTransaction_t * volatile current;
+    DMA_DuplexTransaction_t * queueHead;
+    DMA_DuplexTransaction_t * queueTail;
+    
+    //progress of the current transaction
+    uint32_t position;
+    uint32_t chunk;
+    
+    //coherent scratch memory, fill is sent when there is no tx data, discard receives when there is no rx buffer
+    uint8_t * fill;
+    uint8_t * discard;
+    uint32_t fillWord;
+    uint32_t ownsChannels;
+    
+    //given once the queue ran empty
+    SemaphoreHandle_t doneSemaphore;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef DMAPRIO_INC
+#define DMAPRIO_INC
+
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "DMA.h"
+#include "DMAutils.h"
+#include "DMAconfig.h"
+
+//stack size of the task started by DMA_PRIO_startTask
+#ifndef DMA_PRIO_TASK_STACKSIZE
+#define DMA_PRIO_TASK_STACKSIZE configMINIMAL_STACK_SIZE
+#endif
+
+//default watermarks (in percent of the ring size) of queued TX data at which a stream gets boosted and dropped back again
+#ifndef DMA_PRIO_DEFAULT_HIGHWATER
+#define DMA_PRIO_DEFAULT_HIGHWATER 75
+#endif
+
+#ifndef DMA_PRIO_DEFAULT_LOWWATER
+#define DMA_PRIO_DEFAULT_LOWWATER 25
+#endif
+
+//number of updates a channel stays boosted after it last fell behind its declared rate
+#ifndef DMA_PRIO_BOOST_HOLD
+#define DMA_PRIO_BOOST_HOLD 8
+#endif
+
+//what a channel needs. The class decides its CHPRI while it is doing fine, a ring that falls behind its rate or backs up gets DMA_PRIO_BOOST regardless of the class
+#define DMA_PRIO_CLASS_BULK     0   //memory copies and anything else without a deadline, takes whatever bandwidth is left
+#define DMA_PRIO_CLASS_STREAM   1   //continuous data at a known rate, e.g. audio or adc samples
+#define DMA_PRIO_CLASS_LATENCY  2   //short transfers somebody is waiting on, e.g. protocol rx
+#define DMA_PRIO_BOOST          3
+
+uint32_t DMA_PRIO_register(DmaHandle_t * channel, uint32_t prioClass, DMA_RingBufferHandle_t * ring);
+uint32_t DMA_PRIO_registerRing(DMA_RingBufferHandle_t * ring, uint32_t prioClass);
+uint32_t DMA_PRIO_unregister(DmaHandle_t * channel);
+uint32_t DMA_PRIO_setWatermarks(DmaHandle_t * channel, uint32_t highPercent, uint32_t lowPercent);
+uint32_t DMA_PRIO_setRate(DmaHandle_t * channel, uint32_t bytesPerSecond);
+
+void DMA_PRIO_update();
+uint32_t DMA_PRIO_startTask(uint32_t priority, uint32_t period);
+
+uint32_t DMA_PRIO_isBoosted(DmaHandle_t * channel);
+uint32_t DMA_PRIO_getBoostCount(DmaHandle_t * channel);
+
+#endif
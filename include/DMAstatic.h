@@ -0,0 +1,89 @@
+#ifndef DMASTATIC_INC
+#define DMASTATIC_INC
+
+#include <xc.h>
+#include <stdint.h>
+#include <sys/attribs.h>
+#include <sys/kmem.h>
+
+#include "DMA.h"
+#include "DMAconfig.h"
+#include "DMAtrace.h"
+
+//compile time channel assignment. For a fixed channel map list the channels in DMA_STATIC_CHANNELS in DMAconfig.h, for example
+//  #define DMA_STATIC_CHANNELS ((1 << 0) | (1 << 1))      //channel 0 = uart rx, channel 1 = spi tx
+//those channels are never given out by DMA_allocateChannel and DMA.c leaves their interrupt vectors alone. Instead:
+//  - DMA_STATIC_HANDLE(ch) is a constant handle for the channel, so the regular api works on it without allocating anything
+//  - the DMA_STATIC_xxx(ch, ...) accessors below hit the registers directly. ch must be a literal number, the register names get pasted together
+//  - DMA_STATIC_ISR(ch, handler, data) defines the interrupt vector and calls the handler without going through the dispatch table
+//  - DMA_STATIC_RINGBUFFER(name, ch, size) declares a ring buffer with its channel handle and data buffer, set it up with DMA_RB_init
+
+#define DMA_STATIC_HANDLE(ch) {                         \
+    .CON = (DCHxCON_t*) &DCH##ch##CON,                  \
+    .CONCLR = &DCH##ch##CONCLR,                         \
+    .CONSET = &DCH##ch##CONSET,                         \
+    .ECON = (DCHxECON_t*) &DCH##ch##ECON,               \
+    .ECONSET = &DCH##ch##ECONSET,                       \
+    .INT = (DCHxINT_t*) &DCH##ch##INT,                  \
+    .INTCLR = &DCH##ch##INTCLR,                         \
+    .INTSET = &DCH##ch##INTSET,                         \
+    .SSA = &DCH##ch##SSA,                               \
+    .DSA = &DCH##ch##DSA,                               \
+    .SSIZ = &DCH##ch##SSIZ,                             \
+    .DSIZ = &DCH##ch##DSIZ,                             \
+    .CSIZ = &DCH##ch##CSIZ,                             \
+    .SPTR = &DCH##ch##SPTR,                             \
+    .DPTR = &DCH##ch##DPTR,                             \
+    .CPTR = &DCH##ch##CPTR,                             \
+    .DAT = &DCH##ch##DAT,                               \
+    .IECREG = &DMA_IECREG(ch),                          \
+    .moduleID = ch,                                     \
+    .iecMask = DMA_IEC_BASEMASK << ch,                  \
+    .isrNumber = _DMA##ch##_IRQ                         \
+}
+
+//same interrupt priorities populateHandle uses for dynamically allocated channels. Call once before enabling the channel interrupt
+#define DMA_STATIC_initChannel(ch) do{ DMA_IPC_CH##ch = 4; DMA_ISPC_CH##ch = 3; }while(0)
+
+#define DMA_STATIC_setSrcConfig(ch, src, size) do{ DCH##ch##SSA = KVA_TO_PA(src); DCH##ch##SSIZ = (size); }while(0)
+#define DMA_STATIC_setDestConfig(ch, dest, size) do{ DCH##ch##DSA = KVA_TO_PA(dest); DCH##ch##DSIZ = (size); }while(0)
+#define DMA_STATIC_setCellSize(ch, size) DCH##ch##CSIZ = (size)
+
+#define DMA_STATIC_isEnabled(ch) (DCH##ch##CON & _DCH0CON_CHEN_MASK)
+#define DMA_STATIC_isBusy(ch) (DCH##ch##CON & _DCH0CON_CHBUSY_MASK)
+#define DMA_STATIC_setEnabled(ch, en) do{ if(en) DCH##ch##CONSET = _DCH0CON_CHEN_MASK; else DCH##ch##CONCLR = _DCH0CON_CHEN_MASK; }while(0)
+
+#define DMA_STATIC_forceTransfer(ch) DCH##ch##ECONSET = _DCH0ECON_CFORCE_MASK
+#define DMA_STATIC_abortTransfer(ch) DCH##ch##ECONSET = _DCH0ECON_CABORT_MASK
+
+#define DMA_STATIC_readIF(ch) (DCH##ch##INT & 0xff)
+#define DMA_STATIC_clearIF(ch, mask) DCH##ch##INTCLR = (mask)
+#define DMA_STATIC_setIRQEnabled(ch, en) do{ if(en) DMA_IECREG(ch) |= DMA_IEC_BASEMASK << ch; else DMA_IECREG(ch) &= ~(DMA_IEC_BASEMASK << ch); }while(0)
+
+#define DMA_STATIC_getSourcePointerValue(ch) DCH##ch##SPTR
+#define DMA_STATIC_getDestinationPointerValue(ch) DCH##ch##DPTR
+
+//defines the interrupt vector of a static channel. handler is called as handler(evt, data) just like a DMAIRQHandler_t, if it is visible in the same file (static inline) it gets inlined into the ISR
+#define DMA_STATIC_ISR(ch, handler, data)               \
+void __ISR(_DMA##ch##_VECTOR) DMA##ch##ISR(){           \
+    DMA_IFSCLR = _IFS1_DMA0IF_MASK << ch;               \
+    uint32_t evt = DCH##ch##INT;                        \
+    DCH##ch##INTCLR = evt & 0xff;                       \
+    DMA_TRACE(DMA_TRACE_EVT_ISR, ch, evt & 0xff, 0);    \
+    DMA_isrNesting++;                                   \
+    handler(evt, data);                                 \
+    DMA_isrNesting--;                                   \
+}
+
+//ring buffer on a static channel, no heap involved apart from the data semaphore created by DMA_RB_init:
+//  DMA_STATIC_RINGBUFFER(uartRx, 0, 256);
+//  DMA_STATIC_ISR(0, DMA_RB_ISR, &uartRx)
+//  ...
+//  DMA_STATIC_initChannel(0);
+//  DMA_RB_init(&uartRx, &uartRx_channel, uartRx_data, sizeof(uartRx_data), 1, (uint32_t *) &U1RXREG, _UART1_RX_IRQ, 3, RINGBUFFER_DIRECTION_RX);
+#define DMA_STATIC_RINGBUFFER(name, ch, size)                           \
+    DmaHandle_t name##_channel = DMA_STATIC_HANDLE(ch);                 \
+    uint8_t __attribute__((coherent, aligned(4))) name##_data[size];    \
+    DMA_RingBufferHandle_t name
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef DMATRACE_INC
+#define DMATRACE_INC
+
+#include <stdint.h>
+
+//binary event trace of the DMA driver. Enable with DMA_USE_TRACE in DMAconfig.h, dump with DMA_traceDump and decode the dump on a pc with tools/dmatrace.c
+//the record format and event ids below are shared with the decoder, so this part of the header must stay includable without xc.h
+
+#define DMA_TRACE_MAGIC     0x54414d44  //"DMAT"
+#define DMA_TRACE_VERSION   1
+
+#define DMA_TRACE_EVT_ALLOC         0x01    //arg32 = handle
+#define DMA_TRACE_EVT_FREE          0x02
+#define DMA_TRACE_EVT_CFG_SRC       0x03    //arg16 = size, arg32 = physical address
+#define DMA_TRACE_EVT_CFG_DST       0x04    //arg16 = size, arg32 = physical address
+#define DMA_TRACE_EVT_CFG_XFER      0x05    //arg16 = cell size, arg32 = ECON
+#define DMA_TRACE_EVT_CFG_CHAN      0x06    //arg32 = CON
+#define DMA_TRACE_EVT_CFG_INT       0x07    //arg32 = INT (enable bits)
+#define DMA_TRACE_EVT_ISR           0x08    //arg16 = interrupt flags
+#define DMA_TRACE_EVT_ABORT         0x09    //arg16 = interrupt flags, arg32 = position the channel continues at
+#define DMA_TRACE_EVT_RB_READ       0x0a    //arg16 = bytes read, arg32 = read position afterwards
+#define DMA_TRACE_EVT_RB_WRITE      0x0b    //arg16 = bytes committed, arg32 = write position afterwards
+#define DMA_TRACE_EVT_RB_FLUSH      0x0c    //arg32 = bytes dropped
+
+//one record is 12 bytes, little endian
+typedef struct{
+    uint32_t timestamp;     //core timer
+    uint8_t type;
+    uint8_t channel;
+    uint16_t arg16;
+    uint32_t arg32;
+} DMA_TraceRecord_t;
+
+//written in front of the records by DMA_traceDump
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t timerFrequency;
+    uint32_t recordCount;
+} DMA_TraceHeader_t;
+
+#ifdef __XC32
+#include <xc.h>
+#include "DMAconfig.h"
+
+#ifndef DMA_USE_TRACE
+#define DMA_USE_TRACE 0
+#endif
+
+#if DMA_USE_TRACE
+
+#include "FreeRTOSConfig.h"
+
+//number of records kept, must be a power of two
+#ifndef DMA_TRACE_SIZE
+#define DMA_TRACE_SIZE 256
+#endif
+
+//the core timer runs at half the cpu clock
+#ifndef DMA_TRACE_TIMER_FREQ
+#define DMA_TRACE_TIMER_FREQ (configCPU_CLOCK_HZ / 2)
+#endif
+
+extern DMA_TraceRecord_t DMA_traceBuffer[DMA_TRACE_SIZE];
+extern volatile uint32_t DMA_traceIndex;
+extern volatile uint32_t DMA_traceEnabled;
+
+//claims a slot with an ll/sc increment, so this works from tasks and ISRs alike without disabling interrupts
+static inline void DMA_traceRecord(uint32_t type, uint32_t channel, uint32_t arg16, uint32_t arg32){
+    if(!DMA_traceEnabled) return;
+    
+    DMA_TraceRecord_t * record = &DMA_traceBuffer[__atomic_fetch_add(&DMA_traceIndex, 1, __ATOMIC_RELAXED) & (DMA_TRACE_SIZE - 1)];
+    record->timestamp = _CP0_GET_COUNT();
+    record->type = type;
+    record->channel = channel;
+    record->arg16 = arg16;
+    record->arg32 = arg32;
+}
+
+void DMA_traceSetEnabled(uint32_t enabled);
+void DMA_traceClear();
+uint32_t DMA_traceDump(void (* write)(const void * data, uint32_t length, void * ctx), void * ctx);
+
+#define DMA_TRACE(type, channel, arg16, arg32) DMA_traceRecord((type), (channel), (arg16), (arg32))
+
+#else
+
+#define DMA_TRACE(type, channel, arg16, arg32) do{}while(0)
+
+#endif
+#endif
+
+#endif
@@ -11,37 +11,151 @@
 #include "stream_buffer.h"
 #include "DMA.h"
 
+//set to 1 in DMAconfig.h to let DMA_RB_drain use memory to memory DMA transfers. That pulls in DMAasync.c and DMAvirtual.c and needs event groups
+//(configUSE_TIMERS, INCLUDE_xTimerPendFunctionCall). Without it drain copies with the cpu
+#ifndef DMA_USE_ASYNC
+#define DMA_USE_ASYNC 0
+#endif
+
+//DMA_RB_drain hands copies of at least this many bytes to a memory to memory DMA transfer instead of using memcpy
+#ifndef DMA_RB_DRAIN_THRESHOLD
+#define DMA_RB_DRAIN_THRESHOLD 256
+#endif
+
 #define RINGBUFFER_DIRECTION_RX 0
-#define RINGBUFFER_DIRECTION_TX 1
+#define RINGBUFFER_DIRECTION_TX 1    //an idle TX ring forces the first cell of new data, see DMA_RB_txArm for what that asks of the peripheral
+
+//what happens to unread data when a transfer gets aborted or hits an error
+#define DMA_RB_RECOVERY_RESET       0   //restart at the beginning of the buffer, unread data is dropped and counted in lostBytes
+#define DMA_RB_RECOVERY_PRESERVE    1   //keep unread data and continue writing behind it
+//either way the bytes the DMA wrote after the last position the ring saw are gone, so while PRESERVE or an abort irq is set the cell done
+//interrupt stays on to keep that position current. lostBytes then counts the in-flight cell (plus one more if its cell done wasn't handled yet) as lost
+
+//how DMA_RB_waitForData gets woken up
+#define DMA_RB_NOTIFY_CELL      0   //cell done interrupt, lowest latency but one interrupt per cell
+#define DMA_RB_NOTIFY_HALF      1   //dest half full/done interrupts, two interrupts per buffer pass. Waiting is capped to the latency target
+#define DMA_RB_NOTIFY_TIMEOUT   2   //no interrupts, availability is polled every latency target ticks
+#define DMA_RB_NOTIFY_ADAPTIVE  3   //pick one of the above depending on the measured data rate and wake latency
+
+//reserve flags
+#define DMA_RB_RESERVE_CONTIGUOUS   0x01
 
 typedef struct __DMA_RingBuffer_Descriptor__ DMA_RingBufferHandle_t;
+typedef struct __DMA_RB_Cursor_Descriptor__ DMA_RB_Cursor_t;
+
+//free space in a TX ring handed out by DMA_RB_reserve. The second span is only used if the space wraps around the end of the buffer
+typedef struct{
+    uint8_t * ptr[2];
+    uint32_t length[2];
+} DMA_RB_Span_t;
 
 DMA_RingBufferHandle_t * DMA_createRingBuffer(uint32_t bufferSize, uint32_t dataSize, uint32_t * dataSrc, uint32_t dataReadyInt, uint32_t prio, uint32_t direction);
 void DMA_freeRingBuffer(DMA_RingBufferHandle_t * handle);
+uint32_t DMA_RB_init(DMA_RingBufferHandle_t * ret, DmaHandle_t * channelHandle, uint8_t * data, uint32_t bufferSize, uint32_t dataSize, uint32_t * dataSrc, uint32_t dataReadyInt, uint32_t prio, uint32_t direction);
+
+//channel interrupt handler of the ring buffer, data is the ring handle. Only needs to be called directly from a statically bound ISR (DMA_STATIC_ISR)
+void DMA_RB_ISR(uint32_t evt, void * data);
 
 uint32_t DMA_RB_available(DMA_RingBufferHandle_t * handle);
 uint32_t DMA_RB_availableWords(DMA_RingBufferHandle_t * handle);
 uint32_t DMA_RB_write(DMA_RingBufferHandle_t * handle, uint8_t * src, uint32_t size);
+uint32_t DMA_RB_reserve(DMA_RingBufferHandle_t * handle, uint32_t minBytes, DMA_RB_Span_t * span, uint32_t flags);
+uint32_t DMA_RB_commit(DMA_RingBufferHandle_t * handle, uint32_t bytes);
 uint32_t DMA_RB_read(DMA_RingBufferHandle_t * handle, uint8_t * dst, uint32_t size);
 uint32_t DMA_RB_readWords(DMA_RingBufferHandle_t * handle, uint8_t * dst, uint32_t size);
 uint32_t DMA_RB_readWordPtr(DMA_RingBufferHandle_t * handle, void ** dst);
+uint32_t DMA_RB_readWordPtrs(DMA_RingBufferHandle_t * handle, void ** dst, uint32_t maxCount);
+uint32_t DMA_RB_readWordRun(DMA_RingBufferHandle_t * handle, void ** dst, uint32_t maxCount);
 uint32_t DMA_RB_readSB(DMA_RingBufferHandle_t * handle, StreamBufferHandle_t buffer, uint32_t size);
+uint32_t DMA_RB_drain(DMA_RingBufferHandle_t * handle, uint8_t * dst, uint32_t size, uint32_t timeout);
 uint32_t DMA_RB_flush(DMA_RingBufferHandle_t * handle);
 uint32_t DMA_RB_waitForData(DMA_RingBufferHandle_t * handle, uint32_t timeout);
+void DMA_RB_setAbortIRQ(DMA_RingBufferHandle_t * handle, uint32_t abortIrq, uint32_t autoRestart);
+void DMA_RB_setDataSrc(DMA_RingBufferHandle_t * handle, void * newDataSrc);
+uint8_t * DMA_RB_setBuffer(DMA_RingBufferHandle_t * handle, uint8_t * newData, uint32_t newSize);
+uint32_t DMA_RB_resize(DMA_RingBufferHandle_t * handle, uint32_t newSize);
+uint32_t DMA_RB_setRecoveryMode(DMA_RingBufferHandle_t * handle, uint32_t mode);
+uint32_t DMA_RB_getLostBytes(DMA_RingBufferHandle_t * handle);
+uint32_t DMA_RB_getAbortCount(DMA_RingBufferHandle_t * handle);
+DMA_RB_Cursor_t * DMA_RB_attachCursor(DMA_RingBufferHandle_t * handle, uint32_t overrunThreshold);
+void DMA_RB_detachCursor(DMA_RB_Cursor_t * cursor);
+uint32_t DMA_RB_cursorAvailable(DMA_RB_Cursor_t * cursor);
+uint32_t DMA_RB_cursorRead(DMA_RB_Cursor_t * cursor, uint8_t * dst, uint32_t size);
+uint32_t DMA_RB_cursorGetPtr(DMA_RB_Cursor_t * cursor, void ** dst);
+uint32_t DMA_RB_cursorAdvance(DMA_RB_Cursor_t * cursor, uint32_t size);
+uint32_t DMA_RB_cursorWait(DMA_RB_Cursor_t * cursor, uint32_t timeout);
+uint32_t DMA_RB_cursorGetOverrun(DMA_RB_Cursor_t * cursor);
+uint32_t DMA_RB_getSlowestLag(DMA_RingBufferHandle_t * handle);
+uint32_t DMA_RB_getTransferTotal(DMA_RingBufferHandle_t * handle);
+
+uint32_t DMA_RB_setNotifyPolicy(DMA_RingBufferHandle_t * handle, uint32_t policy, uint32_t latencyTarget, uint32_t maxIrqRate);
 
 struct __DMA_RingBuffer_Descriptor__{
     DmaHandle_t * channelHandle;
     
     uint32_t direction;
-    uint32_t lastReadPos;
+    uint32_t lastReadPos;   //for TX rings this is where the producer writes next
     uint32_t bufferSize;
     uint32_t dataSize;
     uint32_t dataReadyInt;
     uint32_t restartOnError;
     
+    //abort/error recovery. The channel writes to data[writeBase + DPTR], writeBase is only != 0 while it finishes a partial block after a recovery
+    uint32_t recoveryMode;
+    volatile uint32_t writeBase;
+    volatile uint32_t lastWritePos;
+    volatile uint32_t lostBytes;
+    volatile uint32_t abortCount;
+    uint32_t abortIRQSet;
+    uint32_t trackWritePos;     //holds a reference on the cell interrupt so lastWritePos stays current
+    volatile uint32_t rearmHeld;        //DMA_RB_setBuffer is copying into the start of the buffer, rearms don't enable the channel until it's done
+    volatile uint32_t rearmPending;
+    
+    //RX only. Stream position (total bytes written) of data[0] in the current pass through the buffer, used by the cursors
+    volatile uint32_t wrapTotal;
+    DMA_RB_Cursor_t * cursors;
+    uint32_t cellIRQUsers;
+    
+    //TX only. The DMA sends from txTail up to lastReadPos, txActive bytes of which are in the running transfer
+    //txWrapPos is where the data ends before continuing at the start of the buffer, it is only != bufferSize after a contiguous reservation skipped the end
+    volatile uint32_t txTail;
+    volatile uint32_t txActive;
+    volatile uint32_t txWrapPos;
+    uint32_t txReserved;
+    uint32_t txReserveWrapped;
+    volatile uint32_t txSentTotal;  //bytes of finished chunks, the running one isn't in there yet
+    
     uint8_t * data;
     
     SemaphoreHandle_t dataSemaphore;
+    
+    //notification policy. latencyTarget is in ticks, maxIrqRate in interrupts per second (0 = unlimited)
+    uint32_t notifyPolicy;
+    uint32_t notifyMode;
+    uint32_t latencyTarget;
+    uint32_t maxIrqRate;
+    
+    //measured statistics used by the adaptive policy. dataRate is what the DMA moves in bytes per second, wakeLatency in ticks
+    uint32_t dataRate;
+    uint32_t wakeLatency;
+    uint32_t rateLastTotal;
+    TickType_t rateLastTick;
+    volatile TickType_t notifyTick;
+};
+
+//an additional reader of an RX ring. Positions are stream positions (total bytes written by the DMA) so overruns can be detected
+struct __DMA_RB_Cursor_Descriptor__{
+    DMA_RB_Cursor_t * next;
+    DMA_RingBufferHandle_t * ring;
+    
+    uint32_t readTotal;
+    uint32_t ptrTotal;                  //where the data handed out by DMA_RB_cursorGetPtr starts
+    uint32_t overrunThreshold;
+    volatile uint32_t overrunBytes;
+    volatile uint32_t overrunCount;
+    
+    volatile uint32_t waiting;
+    SemaphoreHandle_t dataSemaphore;
 };
 
 #endif
\ No newline at end of file
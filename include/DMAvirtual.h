@@ -0,0 +1,60 @@
+#ifndef DMAVIRTUAL_INC
+#define DMAVIRTUAL_INC
+
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "DMA.h"
+#include "DMAconfig.h"
+
+//maximum number of hardware channels the scheduler may use at the same time. Channels are only held while a transfer is running
+#ifndef DMA_VC_MAXCHANNELS
+#define DMA_VC_MAXCHANNELS DMA_CHANNELCOUNT
+#endif
+
+#define DMA_VC_STATE_IDLE       0
+#define DMA_VC_STATE_QUEUED     1
+#define DMA_VC_STATE_ACTIVE     2
+#define DMA_VC_STATE_DONE       3
+
+//request priorities, these map directly onto CHPRI of the hardware channel and also order the wait queue
+#define DMA_VC_PRIO_LOW         0
+#define DMA_VC_PRIO_HIGHEST     3
+
+typedef struct __DMA_VirtualRequest__ DMA_VirtualRequest_t;
+
+//a transfer request. Memory is owned by the caller and must stay valid until the request is done or cancelled
+struct __DMA_VirtualRequest__{
+    DMA_VirtualRequest_t * next;
+    
+    void * src;
+    uint32_t srcSize;
+    void * dst;
+    uint32_t dstSize;
+    
+    //for memory to memory copies without a startIRQ set cellSize to the full block, the scheduler forces a single cell transfer
+    uint32_t cellSize;
+    int32_t startIRQ;
+    int32_t abortIRQ;
+    uint32_t prio;
+    
+    DMACompletionHandler_t handler;
+    void * data;
+    
+    volatile uint32_t state;
+    volatile uint32_t lastEvt;
+    volatile uint32_t bytesTransferred;
+    DmaHandle_t * channelHandle;
+};
+
+uint32_t DMA_VC_submit(DMA_VirtualRequest_t * request);
+uint32_t DMA_VC_cancel(DMA_VirtualRequest_t * request);
+void DMA_VC_schedule();
+
+uint32_t DMA_VC_getQueueLength();
+uint32_t DMA_VC_getActiveCount();
+
+#define DMA_VC_isDone(request) ((request)->state == DMA_VC_STATE_DONE)
+
+#endif
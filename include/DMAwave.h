@@ -0,0 +1,68 @@
+#ifndef DMAWAVE_INC
+#define DMAWAVE_INC
+
+#include <xc.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "DMA.h"
+#include "DMAconfig.h"
+
+//start flags
+#define DMA_WAVE_FLAG_STREAM    0x01    //a new table is expected for every pass, each pass without one counts as an underrun (the old table just plays again)
+
+typedef struct __DMA_Wave_Descriptor__ DMA_WaveHandle_t;
+
+//plays a table of samples to a peripheral register, one cell per trigger interrupt (usually a timer), over and over again.
+//Two neighbouring channels take turns playing the table and are chained to each other, so the hardware hands over from one pass to the next without
+//missing a trigger. A queued table goes into whichever channel is idle and takes over once the running pass ends, the isr has a whole pass to do that.
+//tables must be in coherent memory, a multiple of the cell size long and stay valid until they were swapped out or playback stopped
+DMA_WaveHandle_t * DMA_createWave(volatile void * dst, uint32_t cellSize, uint32_t triggerIRQ, uint32_t prio);
+void DMA_freeWave(DMA_WaveHandle_t * handle);
+
+uint32_t DMA_WAVE_start(DMA_WaveHandle_t * handle, const uint8_t * table, uint32_t length, uint32_t flags);
+uint32_t DMA_WAVE_stop(DMA_WaveHandle_t * handle);
+uint32_t DMA_WAVE_queueTable(DMA_WaveHandle_t * handle, const uint8_t * table, uint32_t length);
+uint32_t DMA_WAVE_setSwapHandler(DMA_WaveHandle_t * handle, DMACompletionHandler_t handler, void * data);
+
+uint32_t DMA_WAVE_getPosition(DMA_WaveHandle_t * handle);
+uint32_t DMA_WAVE_getWrapCount(DMA_WaveHandle_t * handle);
+uint32_t DMA_WAVE_getUnderruns(DMA_WaveHandle_t * handle);
+uint32_t DMA_WAVE_getLateSwaps(DMA_WaveHandle_t * handle);
+
+#define DMA_WAVE_isRunning(handle) ((handle)->running)
+#define DMA_WAVE_isSwapPending(handle) ((handle)->loadedTable != NULL || (handle)->nextTable != NULL)
+
+struct __DMA_Wave_Descriptor__{
+    //channels[0] is chained to channels[1] and the other way round
+    DmaHandle_t * channels[2];
+    
+    volatile void * dst;
+    uint32_t cellSize;
+    uint32_t triggerIRQ;
+    uint32_t flags;
+    volatile uint32_t running;
+    
+    //what each channel is set up to play
+    const uint8_t * volatile channelTable[2];
+    volatile uint32_t channelLength[2];
+    
+    //table that is playing right now, a queued one that already sits in the idle channel and plays next,
+    //and one that has to wait for a channel to become idle because the other queued one is still waiting for its turn
+    const uint8_t * volatile table;
+    volatile uint32_t length;
+    const uint8_t * volatile loadedTable;
+    volatile uint32_t loadedLength;
+    const uint8_t * volatile nextTable;
+    volatile uint32_t nextLength;
+    
+    volatile uint32_t wraps;
+    volatile uint32_t underruns;
+    volatile uint32_t lateSwaps;        //pass ends the isr only got to after the next pass was over as well
+    
+    //called once a queued table took over, bytes is its length. The previous table is free again at that point
+    DMACompletionHandler_t handler;
+    void * handlerData;
+};
+
+#endif
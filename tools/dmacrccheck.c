@@ -0,0 +1,79 @@
+//checks the software crc against the check values of the crc catalogue (crc of the ascii string "123456789"). Runs on the pc, build with
+//  cc -O2 -Iinclude -o dmacrccheck tools/dmacrccheck.c DMAcrc.c
+//usage: dmacrccheck     (exit code is 1 if any of the checks failed)
+//
+//every entry is run bitwise, with a table, fed in pieces through DMA_CRC_updateSW and through DMA_CRC_compute. This only covers the software path, the engine on the
+//device has to be checked with DMA_CRC_verify
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../include/DMAcrc.h"
+
+typedef struct{
+    const char * name;
+    DMA_CrcConfig_t cfg;
+    uint32_t check;
+} CrcCatalogueEntry_t;
+
+//polynomial, width, seed, reflected, finalXor. Reflected entries are the ones with refin = refout = true in the catalogue
+static const CrcCatalogueEntry_t catalogue[] = {
+    {"CRC-32",              {0x04C11DB7, 32, 0xFFFFFFFF, 1, 0xFFFFFFFF, NULL}, 0xCBF43926},
+    {"CRC-32/BZIP2",        {0x04C11DB7, 32, 0xFFFFFFFF, 0, 0xFFFFFFFF, NULL}, 0xFC891918},
+    {"CRC-32/MPEG-2",       {0x04C11DB7, 32, 0xFFFFFFFF, 0, 0x00000000, NULL}, 0x0376E6E7},
+    {"CRC-32C",             {0x1EDC6F41, 32, 0xFFFFFFFF, 1, 0xFFFFFFFF, NULL}, 0xE3069283},
+    {"CRC-16/CCITT-FALSE",  {0x1021, 16, 0xFFFF, 0, 0x0000, NULL}, 0x29B1},
+    {"CRC-16/XMODEM",       {0x1021, 16, 0x0000, 0, 0x0000, NULL}, 0x31C3},
+    {"CRC-16/KERMIT",       {0x1021, 16, 0x0000, 1, 0x0000, NULL}, 0x2189},
+    {"CRC-16/ARC",          {0x8005, 16, 0x0000, 1, 0x0000, NULL}, 0xBB3D},
+    {"CRC-16/MODBUS",       {0x8005, 16, 0xFFFF, 1, 0x0000, NULL}, 0x4B37},
+    {"CRC-8",               {0x07, 8, 0x00, 0, 0x00, NULL}, 0xF4},
+    {"CRC-8/MAXIM",         {0x31, 8, 0x00, 1, 0x00, NULL}, 0xA1},
+    {"CRC-7/MMC",           {0x09, 7, 0x00, 0, 0x00, NULL}, 0x75},
+    {"CRC-5/USB",           {0x05, 5, 0x1F, 1, 0x1F, NULL}, 0x19},
+    {"CRC-3/GSM",           {0x3, 3, 0x0, 0, 0x7, NULL}, 0x4},
+    {"CRC-3/ROHC",          {0x3, 3, 0x7, 1, 0x0, NULL}, 0x6},
+};
+
+static const uint8_t checkInput[9] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+static uint32_t checkResult(const char * name, const char * variant, uint32_t result, uint32_t expected){
+    if(result == expected) return 1;
+    printf("%-20s %-8s got 0x%08x, expected 0x%08x\n", name, variant, result, expected);
+    return 0;
+}
+
+int main(){
+    uint32_t failed = 0;
+    uint32_t count = sizeof(catalogue) / sizeof(catalogue[0]);
+    uint32_t table[256];
+    
+    for(uint32_t i = 0; i < count; i++){
+        const CrcCatalogueEntry_t * entry = &catalogue[i];
+        DMA_CrcConfig_t cfg = entry->cfg;
+        uint32_t ok = 1;
+        
+        cfg.table = NULL;
+        ok &= checkResult(entry->name, "bitwise", DMA_CRC_computeSW(&cfg, checkInput, sizeof(checkInput)), entry->check);
+        
+        DMA_CRC_initTable(&cfg, table);
+        cfg.table = table;
+        ok &= checkResult(entry->name, "table", DMA_CRC_computeSW(&cfg, checkInput, sizeof(checkInput)), entry->check);
+        
+        //same thing in pieces, the way DMA_CRC_compute feeds long buffers
+        uint32_t crc = cfg.seed;
+        crc = DMA_CRC_updateSW(&cfg, crc, checkInput, 4);
+        crc = DMA_CRC_updateSW(&cfg, crc, &checkInput[4], 0);
+        crc = DMA_CRC_updateSW(&cfg, crc, &checkInput[4], 5);
+        ok &= checkResult(entry->name, "update", crc ^ cfg.finalXor, entry->check);
+        
+        uint32_t result = 0;
+        ok &= DMA_CRC_compute(&cfg, checkInput, sizeof(checkInput), 0, &result) && checkResult(entry->name, "compute", result, entry->check);
+        
+        if(ok) printf("%-20s ok       0x%08x\n", entry->name, entry->check);
+        if(!ok) failed++;
+    }
+    
+    printf("\n%u of %u catalogue entries passed\n", count - failed, count);
+    return failed ? 1 : 0;
+}
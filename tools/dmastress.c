@@ -0,0 +1,1224 @@
+//stress and soak test for the channel allocator, the handler table and the ring buffers. Runs on the pc (x86-64 linux), build with
+//  cc -O2 -pthread -Itools/dmastress -Iinclude -o dmastress tools/dmastress.c DMA.c DMAutils.c
+//usage: dmastress [-t seconds] [-s seed] [-c churnTasks] [-r cursorTasks] [-q]     (runs 10s by default, -q only prints the summary)
+//
+//DMA.c and DMAutils.c are built unchanged against the headers in tools/dmastress, which put the registers into a model of the DMA controller.
+//All tasks share one simulated cpu: a task only runs while it holds the cpu and interrupts are a signal to whoever holds it. Critical sections
+//block that signal, so an interrupt can hit a task anywhere except in one, just like on the target. The interrupt thread also preempts tasks
+//at random (a tick), while the dma thread moves data at the same time as the cpu runs.
+//Registers with a side effect on write (CLR/SET, SSA/DSA) sit on a write protected page. A write to them faults, gets single stepped
+//and then applied by the model before the next instruction runs.
+//
+//checked while running:
+//  - a channel is never handed out twice and the handler table only ever calls a handler with its own data, for the channel it belongs to and
+//    never after the channel was freed
+//  - memory to memory transfers that weren't aborted complete and copy the right data
+//  - every reader of the RX ring (main reader and cursors) and the TX sink see a strictly increasing sequence of cells, so nothing is duplicated
+//    or stale, and a cell only goes missing if the ring reported a loss (lost bytes or cursor overrun) for it, an abort alone doesn't excuse a gap
+//the exit code is 1 if any of that failed
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stream_buffer.h"
+#include "DMA.h"
+#include "DMAutils.h"
+#include <sys/kmem.h>
+
+#define SHIM_IRQ_SIGNAL SIGUSR1
+
+#define HW_MEMORY_SIZE  (16 << 20)
+#define HW_PERIPH_SIZE  4096
+
+//peripheral interrupts the channels get triggered by
+#define HW_IRQ_RX_READY     100
+#define HW_IRQ_TX_READY     101
+#define HW_IRQ_RX_ABORT     102
+
+#define STRESS_MAX_TASKS    16
+#define STRESS_CELL         4
+
+typedef struct{
+    volatile uint32_t rxA;      //both read the same stream, the ring switches between them with DMA_RB_setDataSrc
+    volatile uint32_t rxB;
+    volatile uint32_t tx;
+} HW_Periph_t;
+
+typedef struct{
+    uint64_t ops;
+    uint64_t cells;
+    uint64_t isrs;
+} StressCounter_t;
+
+typedef struct{
+    const char * name;
+    void (* function)(uint32_t index);
+    uint32_t index;
+    pthread_t thread;
+    volatile uint64_t ops;
+} StressTask_t;
+
+//handler data of the allocator churn. Each task has two of them and swaps between them, handler A must only ever see data A and the same for B
+typedef struct{
+    uint32_t kind;
+    uint32_t task;
+    volatile uint32_t alive;
+    volatile uint32_t channel;
+    SemaphoreHandle_t done;
+} StressChurnData_t;
+
+//model memory, the first page holds the peripheral registers and the rest is the heap pvPortMalloc hands out
+uint8_t hwMemory[HW_MEMORY_SIZE] __attribute__((aligned(4096)));
+HW_ChannelRegs_t hwChannel[HW_CHANNELCOUNT];
+HW_ChannelTrapRegs_t * hwTrapRegs;
+
+volatile uint32_t DMA_IEC, DMA_IFSCLR, IEC4;
+volatile uint32_t hwIPC[8], hwISPC[8];
+volatile uint32_t DMACON, DMACONSET, DMACONCLR;
+HW_DMACONbits_t DMACONbits;
+
+static HW_Periph_t * const hwPeriph = (HW_Periph_t *) hwMemory;
+static volatile char hwLock;
+static volatile uint32_t hwForce[HW_CHANNELCOUNT];
+static volatile uint32_t hwInjected[HW_CHANNELCOUNT];
+static volatile uint32_t hwCurrentChannel;
+static uint32_t hwRxLatch;
+static uint32_t hwRxSeq;
+static uint32_t hwTxAssembly;
+
+static __thread volatile uint32_t * hwTrapAddress;
+static __thread sigset_t hwTrapMask;
+static long hwPageSize;
+
+extern void DMA0ISR(void);
+extern void DMA1ISR(void);
+extern void DMA2ISR(void);
+extern void DMA3ISR(void);
+extern void DMA4ISR(void);
+extern void DMA5ISR(void);
+extern void DMA6ISR(void);
+extern void DMA7ISR(void);
+static void (* const hwISR[HW_CHANNELCOUNT])(void) = {DMA0ISR, DMA1ISR, DMA2ISR, DMA3ISR, DMA4ISR, DMA5ISR, DMA6ISR, DMA7ISR};
+
+//the simulated cpu. Whoever holds cpuToken runs, cpuOwner is where interrupts go
+static sem_t cpuToken;
+static volatile pthread_t cpuOwner;
+static volatile uint32_t cpuHeld;
+static volatile uint32_t shimSchedulerSuspended;
+static volatile uint32_t shimYieldPending;
+static volatile uint32_t shimTickPending;
+static __thread uint32_t shimIsTask;
+static __thread uint32_t shimInISR;
+static __thread uint32_t shimCriticalNesting;
+static struct timespec shimStartTime;
+
+static uint8_t * shimHeapTop;
+static void * shimFreeLists[32];
+
+static __thread uint32_t rngState;
+
+static volatile uint32_t stressStop;
+static volatile uint32_t stressFailed;
+static StressTask_t stressTasks[STRESS_MAX_TASKS];
+static uint32_t stressTaskCount;
+static volatile int64_t hwOwner[HW_CHANNELCOUNT];
+static StressCounter_t stressCount;
+
+static DMA_RingBufferHandle_t * stressRx;
+static DMA_RingBufferHandle_t * stressTx;
+static volatile uint32_t stressTxLastSeq;
+static volatile uint32_t stressTxLastLost;
+static SemaphoreHandle_t stressResizeGate;
+
+static uint32_t optSeconds = 10;
+static uint32_t optSeed = 1;
+static uint32_t optChurnTasks = 3;
+static uint32_t optCursorTasks = 2;
+static uint32_t optQuiet = 0;
+
+static uint32_t rng(){
+    uint32_t x = rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rngState = x;
+    return x;
+}
+
+static void stressCount_add(volatile uint64_t * counter, uint64_t amount){
+    __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
+//async signal safe, this gets called from isrs and the model as well
+static void stressFail(const char * fmt, ...){
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(buf, sizeof(buf) - 1, fmt, args);
+    va_end(args);
+    if(length < 0) length = 0;
+    if(length > (int) sizeof(buf) - 2) length = sizeof(buf) - 2;
+    buf[length++] = '\n';
+    
+    //only the first failure is interesting, everything after it is most likely a consequence
+    if(__atomic_exchange_n(&stressFailed, 1, __ATOMIC_SEQ_CST) == 0){
+        if(write(2, "FAIL: ", 6) < 0 || write(2, buf, length) < 0){}
+    }
+    stressStop = 1;
+}
+
+void SHIM_assertFailed(const char * file, int line, const char * expr){
+    stressFail("configASSERT(%s) failed in %s:%d", expr, file, line);
+    
+    //the driver doesn't expect to return from a failed assert, so stop right here
+    for(;;) pause();
+}
+
+
+//----- simulated cpu -----
+
+static void cpuAcquire(){
+    while(sem_wait(&cpuToken) != 0);
+    cpuOwner = pthread_self();
+    cpuHeld = 1;
+}
+
+static void cpuRelease(){
+    cpuHeld = 0;
+    sem_post(&cpuToken);
+}
+
+static void shimSetIRQMasked(uint32_t masked){
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SHIM_IRQ_SIGNAL);
+    pthread_sigmask(masked ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+}
+
+//gives the cpu to whoever else wants it. Only ever called by a task outside of critical sections
+static void shimSwitch(){
+    cpuRelease();
+    sched_yield();
+    cpuAcquire();
+}
+
+void taskENTER_CRITICAL(void){
+    if(shimCriticalNesting++ == 0 && !shimInISR) shimSetIRQMasked(1);
+}
+
+void taskEXIT_CRITICAL(void){
+    configASSERT(shimCriticalNesting > 0);
+    if(--shimCriticalNesting == 0 && !shimInISR) shimSetIRQMasked(0);
+}
+
+UBaseType_t taskENTER_CRITICAL_FROM_ISR(void){
+    taskENTER_CRITICAL();
+    return 0;
+}
+
+void taskEXIT_CRITICAL_FROM_ISR(UBaseType_t state){
+    (void) state;
+    taskEXIT_CRITICAL();
+}
+
+void vTaskSuspendAll(void){
+    shimSchedulerSuspended++;
+}
+
+BaseType_t xTaskResumeAll(void){
+    configASSERT(shimSchedulerSuspended > 0);
+    if(--shimSchedulerSuspended == 0 && shimYieldPending && shimIsTask && shimCriticalNesting == 0){
+        shimYieldPending = 0;
+        shimSwitch();
+        return pdTRUE;
+    }
+    return pdFALSE;
+}
+
+void taskYIELD(void){
+    if(shimIsTask && shimCriticalNesting == 0 && shimSchedulerSuspended == 0) shimSwitch();
+}
+
+void SHIM_yieldFromISR(BaseType_t woken){
+    if(woken) shimYieldPending = 1;
+}
+
+TickType_t xTaskGetTickCount(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - shimStartTime.tv_sec) * configTICK_RATE_HZ + (now.tv_nsec - shimStartTime.tv_nsec) / (1000000000 / configTICK_RATE_HZ);
+}
+
+TickType_t xTaskGetTickCountFromISR(void){
+    return xTaskGetTickCount();
+}
+
+static void shimSleep(uint32_t microseconds){
+    struct timespec time = {.tv_sec = microseconds / 1000000, .tv_nsec = (microseconds % 1000000) * 1000};
+    while(nanosleep(&time, &time) != 0 && errno == EINTR);
+}
+
+void vTaskDelay(TickType_t ticks){
+    configASSERT(shimCriticalNesting == 0 && shimSchedulerSuspended == 0 && !shimInISR);
+    
+    if(ticks == 0){
+        shimSwitch();
+        return;
+    }
+    
+    cpuRelease();
+    shimSleep(ticks * (1000000 / configTICK_RATE_HZ));
+    cpuAcquire();
+}
+
+//size classes of 16 << n bytes. The heap has to be inside hwMemory, so the channel model can address it with 32 bits
+void * pvPortMalloc(size_t size){
+    uint32_t sizeClass = 0;
+    while(((size_t) 16 << sizeClass) < size + 16) sizeClass++;
+    
+    vTaskSuspendAll();
+    
+    uint8_t * block = shimFreeLists[sizeClass];
+    if(block != NULL){
+        shimFreeLists[sizeClass] = *(void **) (block + 16);
+    }else if(shimHeapTop + ((size_t) 16 << sizeClass) <= hwMemory + HW_MEMORY_SIZE){
+        block = shimHeapTop;
+        shimHeapTop += (size_t) 16 << sizeClass;
+    }
+    
+    xTaskResumeAll();
+    
+    if(block == NULL) return NULL;
+    *(uint32_t *) block = sizeClass;
+    
+    //stale data in a fresh allocation must never look like valid cells
+    memset(block + 16, 0xa5, ((size_t) 16 << sizeClass) - 16);
+    return block + 16;
+}
+
+void vPortFree(void * ptr){
+    if(ptr == NULL) return;
+    uint8_t * block = (uint8_t *) ptr - 16;
+    uint32_t sizeClass = *(uint32_t *) block;
+    
+    memset(ptr, 0x5a, ((size_t) 16 << sizeClass) - 16);
+    
+    vTaskSuspendAll();
+    *(void **) ptr = shimFreeLists[sizeClass];
+    shimFreeLists[sizeClass] = block;
+    xTaskResumeAll();
+}
+
+struct SHIM_Semaphore{
+    volatile uint32_t count;
+    sem_t wake;
+};
+
+static SemaphoreHandle_t shimSemaphoreCreate(uint32_t count){
+    SemaphoreHandle_t ret = pvPortMalloc(sizeof(struct SHIM_Semaphore));
+    if(ret == NULL) return NULL;
+    ret->count = count;
+    sem_init(&ret->wake, 0, 0);
+    return ret;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void){
+    return shimSemaphoreCreate(0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void){
+    return shimSemaphoreCreate(1);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem){
+    sem_destroy(&sem->wake);
+    vPortFree(sem);
+}
+
+static uint32_t shimSemaphoreTryTake(SemaphoreHandle_t sem){
+    uint32_t expected = 1;
+    return __atomic_compare_exchange_n(&sem->count, &expected, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout){
+    if(shimSemaphoreTryTake(sem)) return pdTRUE;
+    if(timeout == 0) return pdFALSE;
+    configASSERT(shimCriticalNesting == 0 && shimSchedulerSuspended == 0 && !shimInISR);
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = (uint64_t) ((timeout > 100000) ? 100000 : timeout) * (1000000000 / configTICK_RATE_HZ) + deadline.tv_nsec;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    
+    //the wake semaphore might hold stale posts, the count is what matters
+    BaseType_t ret = pdFALSE;
+    cpuRelease();
+    while(1){
+        if(shimSemaphoreTryTake(sem)){
+            ret = pdTRUE;
+            break;
+        }
+        if(sem_timedwait(&sem->wake, &deadline) != 0 && errno == ETIMEDOUT){
+            ret = shimSemaphoreTryTake(sem);
+            break;
+        }
+    }
+    cpuAcquire();
+    
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem){
+    if(__atomic_exchange_n(&sem->count, 1, __ATOMIC_SEQ_CST) != 0) return pdFALSE;
+    sem_post(&sem->wake);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t * woken){
+    BaseType_t ret = xSemaphoreGive(sem);
+    if(ret && woken != NULL) *woken = pdTRUE;
+    return ret;
+}
+
+size_t xStreamBufferSend(StreamBufferHandle_t buffer, const void * data, size_t length, TickType_t timeout){
+    return 0;
+}
+
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t buffer){
+    return 0;
+}
+
+
+//----- channel model -----
+
+static void hwLockTake(){
+    while(__atomic_test_and_set(&hwLock, __ATOMIC_ACQUIRE)) sched_yield();
+}
+
+static void hwLockGive(){
+    __atomic_clear(&hwLock, __ATOMIC_RELEASE);
+}
+
+//abort without the abort interrupt (CABORT) or with it (abort irq matched), the channel stops and starts over once enabled again
+static void hwAbort(uint32_t ch, uint32_t flags){
+    __atomic_and_fetch(&hwChannel[ch].CON, ~_DCH0CON_CHEN_MASK, __ATOMIC_SEQ_CST);
+    hwChannel[ch].SPTR = 0;
+    hwChannel[ch].DPTR = 0;
+    hwChannel[ch].CPTR = 0;
+    hwForce[ch] = 0;
+    if(flags) __atomic_or_fetch(&hwChannel[ch].INT, flags, __ATOMIC_SEQ_CST);
+}
+
+//applies a write to one of the registers on the trap page. Called from the trap handler right after the write happened
+static void hwApplyWrite(volatile uint32_t * reg){
+    uint32_t offset = (uint8_t *) reg - (uint8_t *) hwTrapRegs;
+    uint32_t ch = offset / sizeof(HW_ChannelTrapRegs_t);
+    if(ch >= HW_CHANNELCOUNT) return;
+    
+    HW_ChannelTrapRegs_t * trap = &hwTrapRegs[ch];
+    HW_ChannelRegs_t * regs = &hwChannel[ch];
+    uint32_t value = *reg;
+    
+    hwLockTake();
+    if(reg == &trap->CONCLR){
+        __atomic_and_fetch(&regs->CON, ~value, __ATOMIC_SEQ_CST);
+        trap->CONCLR = 0;
+    }else if(reg == &trap->CONSET){
+        __atomic_or_fetch(&regs->CON, value, __ATOMIC_SEQ_CST);
+        trap->CONSET = 0;
+    }else if(reg == &trap->ECONSET){
+        if(value & _DCH0ECON_CABORT_MASK) hwAbort(ch, 0);
+        if((value & _DCH0ECON_CFORCE_MASK) && (regs->CON & _DCH0CON_CHEN_MASK)) hwForce[ch] = 1;
+        __atomic_or_fetch(&regs->ECON, value & ~(_DCH0ECON_CABORT_MASK | _DCH0ECON_CFORCE_MASK), __ATOMIC_SEQ_CST);
+        trap->ECONSET = 0;
+    }else if(reg == &trap->INTCLR){
+        __atomic_and_fetch(&regs->INT, ~value, __ATOMIC_SEQ_CST);
+        trap->INTCLR = 0;
+    }else if(reg == &trap->INTSET){
+        __atomic_or_fetch(&regs->INT, value, __ATOMIC_SEQ_CST);
+        trap->INTSET = 0;
+    }else if(reg == &trap->SSA){
+        //writing an address resets the pointers
+        regs->SPTR = 0;
+        regs->CPTR = 0;
+    }else if(reg == &trap->DSA){
+        regs->DPTR = 0;
+        regs->CPTR = 0;
+    }
+    hwLockGive();
+}
+
+static void hwSegvHandler(int sig, siginfo_t * info, void * context){
+    ucontext_t * uc = (ucontext_t *) context;
+    uint8_t * address = (uint8_t *) info->si_addr;
+    
+    if(address < (uint8_t *) hwTrapRegs || address >= (uint8_t *) hwTrapRegs + hwPageSize){
+        //a real crash
+        char buf[96];
+        int length = snprintf(buf, sizeof(buf), "crash: access to %p at %p\n", info->si_addr, (void *) uc->uc_mcontext.gregs[REG_RIP]);
+        if(write(2, buf, length) < 0){}
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    
+    //let the write through and stop right after it. Interrupts stay off until then, an isr would get to the unprotected page as well
+    hwTrapAddress = (volatile uint32_t *) ((uintptr_t) address & ~(uintptr_t) 3);
+    hwTrapMask = uc->uc_sigmask;
+    sigaddset(&uc->uc_sigmask, SHIM_IRQ_SIGNAL);
+    mprotect(hwTrapRegs, hwPageSize, PROT_READ | PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= 0x100;
+}
+
+static void hwTrapHandler(int sig, siginfo_t * info, void * context){
+    ucontext_t * uc = (ucontext_t *) context;
+    if(hwTrapAddress == NULL) return;
+    
+    uc->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+    hwApplyWrite(hwTrapAddress);
+    hwTrapAddress = NULL;
+    mprotect(hwTrapRegs, hwPageSize, PROT_READ);
+    uc->uc_sigmask = hwTrapMask;
+}
+
+static uint32_t hwRxSpace(){
+    DMA_RingBufferHandle_t * rb = stressRx;
+    if(rb == NULL) return 0;
+    
+    uint32_t ch = rb->channelHandle->moduleID;
+    uint32_t size = rb->bufferSize;
+    uint32_t read = rb->lastReadPos;
+    uint32_t write = rb->writeBase + hwChannel[ch].DPTR;
+    if(rb->writeBase != 0 && (hwChannel[ch].INT & _DCH0INT_CHBCIF_MASK)) write = 0;
+    write %= size;
+    
+    uint32_t used = (write >= read) ? write - read : write + size - read;
+    return size - used;
+}
+
+//the rx peripheral has flow control, it only delivers data while the main reader has room for it. Cursors that fall behind get overrun
+static uint32_t hwTriggered(uint32_t irq){
+    if(irq == HW_IRQ_RX_READY) return (rng() & 3) == 0 && hwRxSpace() > 4 * STRESS_CELL;
+    if(irq == HW_IRQ_TX_READY) return (rng() & 3) == 0;
+    return 0;
+}
+
+static uint8_t hwReadByte(uint32_t pa){
+    if(pa < HW_PERIPH_SIZE){
+        uint32_t reg = pa & ~3;
+        uint32_t byte = pa & 3;
+        if(reg == KVA_TO_PA(&hwPeriph->rxA) || reg == KVA_TO_PA(&hwPeriph->rxB)){
+            if(byte == 0) hwRxLatch = ++hwRxSeq;
+            return hwRxLatch >> (8 * byte);
+        }
+        return 0;
+    }
+    return hwMemory[pa];
+}
+
+static void hwWriteByte(uint32_t pa, uint8_t value){
+    if(pa >= HW_PERIPH_SIZE){
+        hwMemory[pa] = value;
+        return;
+    }
+    
+    if((pa & ~3) != KVA_TO_PA(&hwPeriph->tx)) return;
+    
+    uint32_t byte = pa & 3;
+    if(byte == 0) hwTxAssembly = 0;
+    hwTxAssembly |= (uint32_t) value << (8 * byte);
+    if(byte != 3) return;
+    
+    //a whole cell went out, check it against the ones before
+    uint32_t seq = hwTxAssembly;
+    if(seq <= stressTxLastSeq){
+        stressFail("tx sink: cell %u after %u, duplicated or stale data was sent", seq, stressTxLastSeq);
+    }else if(seq != stressTxLastSeq + 1){
+        if(stressTx->lostBytes == stressTxLastLost) stressFail("tx sink: cells %u to %u went missing without the ring reporting a loss", stressTxLastSeq + 1, seq - 1);
+    }
+    stressTxLastSeq = seq;
+    stressTxLastLost = stressTx->lostBytes;
+    stressCount_add(&stressCount.cells, 1);
+}
+
+static uint32_t hwInRange(uint32_t pa, uint32_t size){
+    return size <= HW_MEMORY_SIZE && pa <= HW_MEMORY_SIZE - size;
+}
+
+//moves one cell. Called with hwLock taken, so the cell is atomic to the cpu's register writes
+static void hwTransferCell(uint32_t ch){
+    HW_ChannelRegs_t * regs = &hwChannel[ch];
+    HW_ChannelTrapRegs_t * trap = &hwTrapRegs[ch];
+    
+    uint32_t srcSize = regs->SSIZ ? regs->SSIZ : 65536;
+    uint32_t dstSize = regs->DSIZ ? regs->DSIZ : 65536;
+    uint32_t cellSize = regs->CSIZ ? regs->CSIZ : 65536;
+    uint32_t blockSize = (srcSize > dstSize) ? srcSize : dstSize;
+    uint32_t src = trap->SSA;
+    uint32_t dst = trap->DSA;
+    
+    if(!hwInRange(src, srcSize) || !hwInRange(dst, dstSize)){
+        hwAbort(ch, _DCH0INT_CHERIF_MASK);
+        return;
+    }
+    
+    uint32_t sptr = regs->SPTR;
+    uint32_t dptr = regs->DPTR;
+    uint32_t done = regs->CPTR;
+    uint32_t flags = 0;
+    
+    for(uint32_t i = 0; i < cellSize && done < blockSize; i++){
+        hwWriteByte(dst + dptr, hwReadByte(src + sptr));
+        done++;
+        
+        if(++sptr == srcSize / 2) flags |= _DCH0INT_CHSHIF_MASK;
+        if(sptr >= srcSize){
+            sptr = 0;
+            flags |= _DCH0INT_CHSDIF_MASK;
+        }
+        if(++dptr == dstSize / 2) flags |= _DCH0INT_CHDHIF_MASK;
+        if(dptr >= dstSize){
+            dptr = 0;
+            flags |= _DCH0INT_CHDDIF_MASK;
+        }
+    }
+    flags |= _DCH0INT_CHCCIF_MASK;
+    
+    if(done >= blockSize){
+        flags |= _DCH0INT_CHBCIF_MASK;
+        sptr = 0;
+        dptr = 0;
+        done = 0;
+        if(!(regs->CON & _DCH0CON_CHAEN_MASK)) __atomic_and_fetch(&regs->CON, ~_DCH0CON_CHEN_MASK, __ATOMIC_SEQ_CST);
+    }
+    
+    //the pointers only move once the data is there
+    __atomic_store_n(&regs->SPTR, sptr, __ATOMIC_RELEASE);
+    __atomic_store_n(&regs->DPTR, dptr, __ATOMIC_RELEASE);
+    regs->CPTR = done;
+    __atomic_or_fetch(&regs->INT, flags, __ATOMIC_SEQ_CST);
+}
+
+//abort irq of a peripheral fired, every channel listening for it stops
+static void hwRaiseAbortIRQ(uint32_t irq){
+    hwLockTake();
+    for(uint32_t ch = 0; ch < HW_CHANNELCOUNT; ch++){
+        uint32_t econ = hwChannel[ch].ECON;
+        if(!(hwChannel[ch].CON & _DCH0CON_CHEN_MASK) || !(econ & _DCH0ECON_AIRQEN_MASK)) continue;
+        if(((econ & _DCH0ECON_CHAIRQ_MASK) >> _DCH0ECON_CHAIRQ_POSITION) == irq) hwAbort(ch, _DCH0INT_CHTAIF_MASK);
+    }
+    hwLockGive();
+}
+
+static void * hwDmaThread(void * params){
+    rngState = optSeed * 7919 + 1;
+    
+    while(!stressStop){
+        uint32_t moved = 0;
+        
+        for(uint32_t ch = 0; ch < HW_CHANNELCOUNT; ch++){
+            hwLockTake();
+            HW_ChannelRegs_t * regs = &hwChannel[ch];
+            if(regs->CON & _DCH0CON_CHEN_MASK){
+                if(hwForce[ch]){
+                    hwForce[ch] = 0;
+                    hwTransferCell(ch);
+                    moved = 1;
+                }else if((regs->ECON & _DCH0ECON_SIRQEN_MASK) && hwTriggered((regs->ECON & _DCH0ECON_CHSIRQ_MASK) >> _DCH0ECON_CHSIRQ_POSITION)){
+                    hwTransferCell(ch);
+                    moved = 1;
+                }
+            }
+            hwLockGive();
+        }
+        
+        //leave the cpu to the tasks, on a single core machine they would hardly ever run otherwise
+        if(moved) sched_yield(); else shimSleep(10);
+    }
+    
+    return NULL;
+}
+
+static uint32_t hwIRQPending(uint32_t ch){
+    volatile uint32_t * iec = (ch < 4) ? &DMA_IEC : &IEC4;
+    if(!(*iec & (DMA_IEC_BASEMASK << ch))) return 0;
+    
+    uint32_t intReg = hwChannel[ch].INT;
+    return (intReg & (intReg >> 16) & 0xff) != 0;
+}
+
+//runs the isr of every channel with a pending (or injected) interrupt. Called with the cpu held, either in the signal handler or by the interrupt thread while no task runs
+static void hwServiceInterrupts(){
+    shimInISR = 1;
+    for(uint32_t ch = 0; ch < HW_CHANNELCOUNT; ch++){
+        uint32_t injected = __atomic_exchange_n(&hwInjected[ch], 0, __ATOMIC_SEQ_CST);
+        if(!injected && !hwIRQPending(ch)) continue;
+        
+        hwCurrentChannel = ch;
+        hwISR[ch]();
+        hwCurrentChannel = HW_CHANNELCOUNT;
+        stressCount_add(&stressCount.isrs, 1);
+    }
+    shimInISR = 0;
+}
+
+static void shimIRQHandler(int sig){
+    int savedErrno = errno;
+    
+    //the signal came in while this thread didn't have the cpu (any more), the interrupt thread will try again
+    if(!cpuHeld || !pthread_equal(cpuOwner, pthread_self())){
+        errno = savedErrno;
+        return;
+    }
+    
+    hwServiceInterrupts();
+    
+    if(shimTickPending){
+        shimTickPending = 0;
+        shimYieldPending = 1;
+    }
+    
+    if(shimYieldPending && shimIsTask && shimSchedulerSuspended == 0){
+        shimYieldPending = 0;
+        shimSwitch();
+    }
+    
+    errno = savedErrno;
+}
+
+static void * hwInterruptThread(void * params){
+    rngState = optSeed * 104729 + 3;
+    
+    while(!stressStop){
+        shimSleep(rng() % 20);
+        
+        uint32_t r = rng();
+        if((r & 7) == 0) hwInjected[(r >> 8) % HW_CHANNELCOUNT] = 1;     //spurious interrupt
+        if((r & 3) == 1) shimTickPending = 1;
+        if(((r >> 16) % 3000) == 0) hwRaiseAbortIRQ(HW_IRQ_RX_ABORT);
+        
+        uint32_t pending = shimTickPending;
+        for(uint32_t ch = 0; ch < HW_CHANNELCOUNT; ch++) pending |= hwInjected[ch] || hwIRQPending(ch);
+        if(!pending) continue;
+        
+        if(sem_trywait(&cpuToken) == 0){
+            //nobody is running, the isr interrupts the idle task
+            cpuOwner = pthread_self();
+            cpuHeld = 1;
+            hwServiceInterrupts();
+            shimTickPending = 0;
+            shimYieldPending = 0;
+            cpuRelease();
+        }else if(cpuHeld){
+            pthread_kill(cpuOwner, SHIM_IRQ_SIGNAL);
+        }
+    }
+    
+    return NULL;
+}
+
+
+//----- workload -----
+
+static void stressChurnCheck(StressChurnData_t * data, uint32_t kind, uint32_t evt){
+    if(data->kind != kind){
+        stressFail("handler %c called with the data of handler %c (task %u)", 'A' + kind, 'A' + data->kind, data->task);
+    }else if(!data->alive){
+        stressFail("handler of task %u called after its channel was freed (channel %u, evt 0x%02x)", data->task, hwCurrentChannel, evt & 0xff);
+    }else if(data->channel != hwCurrentChannel){
+        stressFail("handler of task %u (channel %u) called from the isr of channel %u", data->task, data->channel, hwCurrentChannel);
+    }
+    
+    if(evt & _DCH0INT_CHBCIF_MASK){
+        BaseType_t woken = pdFALSE;
+        DMA_semaphoreGiveFromHandler(data->done, &woken);
+        DMA_yieldFromHandler(woken);
+    }
+}
+
+static void stressChurnHandlerA(uint32_t evt, void * data){
+    stressChurnCheck((StressChurnData_t *) data, 0, evt);
+}
+
+static void stressChurnHandlerB(uint32_t evt, void * data){
+    stressChurnCheck((StressChurnData_t *) data, 1, evt);
+}
+
+static void stressTake(uint32_t task, DmaHandle_t * handle){
+    int64_t expected = 0;
+    if(!__atomic_compare_exchange_n(&hwOwner[handle->moduleID], &expected, task + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+        stressFail("channel %u handed to task %u while task %d still owns it", handle->moduleID, task, (int) expected - 1);
+    }
+}
+
+static void stressGive(DmaHandle_t * handle){
+    hwOwner[handle->moduleID] = 0;
+}
+
+//one memory to memory transfer on a freshly allocated channel, with a handler swap or an abort thrown in now and then
+static void stressChurnTransfer(uint32_t task, DmaHandle_t * handle, StressChurnData_t * data){
+    uint32_t length = 4 + (rng() % 1024);
+    uint8_t * src = pvPortMalloc(length);
+    uint8_t * dst = pvPortMalloc(length);
+    if(src == NULL || dst == NULL){
+        stressFail("model heap ran out");
+        return;
+    }
+    
+    for(uint32_t i = 0; i < length; i++) src[i] = rng();
+    
+    uint32_t kind = rng() & 1;
+    data[0].channel = data[1].channel = handle->moduleID;
+    data[0].alive = data[1].alive = 1;
+    xSemaphoreTake(data[0].done, 0);
+    
+    DMA_setIRQHandler(handle, kind ? stressChurnHandlerB : stressChurnHandlerA, &data[kind]);
+    DMA_setSrcConfig(handle, (uint32_t *) src, length);
+    DMA_setDestConfig(handle, (uint32_t *) dst, length);
+    DMA_setTransferAttributes(handle, length, -1, -1);
+    DMA_setChannelAttributes(handle, 0, 0, 0, 0, rng() & 3);
+    DMA_setInterruptConfig(handle, 0, 0, 0, 0, 1, 0, 1, 1);
+    DMA_setIRQEnabled(handle, 1);
+    DMA_setEnabled(handle, 1);
+    DMA_forceTransfer(handle);
+    
+    uint32_t action = rng() % 8;
+    uint32_t aborted = 0;
+    if(action == 0){
+        kind ^= 1;
+        DMA_setIRQHandler(handle, kind ? stressChurnHandlerB : stressChurnHandlerA, &data[kind]);
+    }else if(action == 1){
+        DMA_abortTransfer(handle);
+        aborted = 1;
+    }
+    
+    //an aborted copy usually never completes, no need to wait long for it
+    if(xSemaphoreTake(data[0].done, aborted ? 2 : 200)){
+        if(memcmp(src, dst, length) != 0) stressFail("memory to memory transfer of %u bytes on channel %u copied the wrong data", length, handle->moduleID);
+    }else if(!aborted && !stressStop){
+        //the copy may have completed before the abort, so only a transfer that wasn't aborted must finish. The DMA model stops with the run
+        stressFail("memory to memory transfer on channel %u never completed", handle->moduleID);
+    }
+    
+    vPortFree(src);
+    vPortFree(dst);
+}
+
+static void stressChurnTask(uint32_t index){
+    StressChurnData_t data[2];
+    DmaHandle_t staticHandle;
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    
+    for(uint32_t i = 0; i < 2; i++){
+        data[i].kind = i;
+        data[i].task = index;
+        data[i].alive = 0;
+        data[i].channel = HW_CHANNELCOUNT;
+        data[i].done = done;
+    }
+    
+    while(!stressStop){
+        uint32_t mode = rng() % 4;
+        
+        if(mode == 0){
+            //heap free claim on a handle we own
+            if(!DMA_claimChannel(&staticHandle)){
+                taskYIELD();
+                continue;
+            }
+            stressTake(index, &staticHandle);
+            stressChurnTransfer(index, &staticHandle, data);
+            stressGive(&staticHandle);
+            DMA_releaseChannel(&staticHandle);
+        }else if(mode == 1){
+            DmaHandle_t * low;
+            DmaHandle_t * high;
+            if(!DMA_allocateChannelPair(&low, &high)){
+                taskYIELD();
+                continue;
+            }
+            if(high->moduleID != low->moduleID + 1) stressFail("channel pair %u/%u isn't adjacent", low->moduleID, high->moduleID);
+            stressTake(index, low);
+            stressTake(index, high);
+            stressChurnTransfer(index, (rng() & 1) ? high : low, data);
+            stressGive(low);
+            stressGive(high);
+            DMA_freeChannel(low);
+            DMA_freeChannel(high);
+        }else{
+            DmaHandle_t * handle = DMA_allocateChannel();
+            if(handle == NULL){
+                taskYIELD();
+                continue;
+            }
+            stressTake(index, handle);
+            stressChurnTransfer(index, handle, data);
+            stressGive(handle);
+            DMA_freeChannel(handle);
+        }
+        
+        //nothing may call our handler from here on
+        data[0].alive = data[1].alive = 0;
+        stressTasks[index].ops++;
+    }
+}
+
+//checks cells coming out of a ring reader. A gap is only fine if the ring reported a loss since the previous gap. Losses get reported
+//when they happen, which can be well before the reader gets to the spot where the data is missing
+typedef struct{
+    const char * name;
+    uint32_t lastSeq;
+    uint32_t lossMark;
+} StressStream_t;
+
+static void stressCheckCells(StressStream_t * stream, const uint8_t * data, uint32_t length, uint32_t lossMarkBefore, uint32_t lossMarkAfter){
+    if(length % STRESS_CELL) stressFail("%s: read of %u bytes isn't a whole number of cells", stream->name, length);
+    
+    for(uint32_t i = 0; i + STRESS_CELL <= length; i += STRESS_CELL){
+        uint32_t seq;
+        memcpy(&seq, &data[i], sizeof(seq));
+        
+        if(seq <= stream->lastSeq){
+            stressFail("%s: cell %u after %u, duplicated or stale data", stream->name, seq, stream->lastSeq);
+            return;
+        }
+        if(seq != stream->lastSeq + 1 && lossMarkAfter == stream->lossMark){
+            stressFail("%s: cells %u to %u went missing without the ring reporting a loss", stream->name, stream->lastSeq + 1, seq - 1);
+            return;
+        }
+        
+        //the loss is used up. One that got reported while this read ran might still show up in a later one
+        if(seq != stream->lastSeq + 1) stream->lossMark = lossMarkBefore;
+        stream->lastSeq = seq;
+    }
+    
+    stressCount_add(&stressCount.cells, length / STRESS_CELL);
+}
+
+static uint32_t stressRxLossMark(){
+    return stressRx->lostBytes;
+}
+
+//main reader of the RX ring. Also owns the ring, so flushes, resizes and the other reconfiguration happen here
+static void stressRxTask(uint32_t index){
+    StressStream_t stream = {.name = "rx main reader", .lastSeq = 0, .lossMark = stressRxLossMark()};
+    uint8_t * buf = pvPortMalloc(8192);
+    static const uint32_t sizes[] = {64, 128, 256, 1000, 4096};
+    
+    while(!stressStop){
+        uint32_t action = rng() % 1000;
+        
+        if(action < 4){
+            DMA_RB_flush(stressRx);
+        }else if(action < 8){
+            //cursor readers can't be in the middle of a copy while the buffer moves, see stressCursorTask
+            xSemaphoreTake(stressResizeGate, portMAX_DELAY);
+            DMA_RB_resize(stressRx, sizes[rng() % 5]);
+            xSemaphoreGive(stressResizeGate);
+        }else if(action < 12){
+            DMA_RB_setDataSrc(stressRx, (rng() & 1) ? (void *) &hwPeriph->rxA : (void *) &hwPeriph->rxB);
+        }else if(action < 14){
+            DMA_RB_setRecoveryMode(stressRx, rng() & 1);
+        }else if(action < 30){
+            DMA_RB_waitForData(stressRx, 5);
+        }else{
+            uint32_t mark = stressRxLossMark();
+            uint32_t length = 0;
+            uint32_t cells = 1 + rng() % 64;
+            
+            switch(rng() % 3){
+                case 0:
+                    length = DMA_RB_read(stressRx, buf, cells * STRESS_CELL);
+                    break;
+                case 1:
+                    length = DMA_RB_readWords(stressRx, buf, cells) * STRESS_CELL;
+                    break;
+                case 2:
+                    length = DMA_RB_drain(stressRx, buf, cells * STRESS_CELL, 1);
+                    break;
+            }
+            
+            stressCheckCells(&stream, buf, length, mark, stressRxLossMark());
+        }
+        
+        stressTasks[index].ops++;
+    }
+    
+    vPortFree(buf);
+}
+
+static void stressCursorTask(uint32_t index){
+    char name[32];
+    snprintf(name, sizeof(name), "rx cursor %u", index);
+    uint8_t * buf = pvPortMalloc(8192);
+    
+    while(!stressStop){
+        //start over with a fresh cursor every now and then
+        DMA_RB_Cursor_t * cursor = DMA_RB_attachCursor(stressRx, (rng() & 1) ? 0 : STRESS_CELL * (16 + rng() % 64));
+        StressStream_t stream = {.name = name, .lastSeq = 0, .lossMark = 0};
+        uint32_t first = 1;
+        uint32_t reads = 100 + rng() % 10000;
+        
+        for(uint32_t i = 0; i < reads && !stressStop; i++){
+            xSemaphoreTake(stressResizeGate, portMAX_DELAY);
+            
+            uint32_t mark = cursor->overrunBytes + stressRx->lostBytes;
+            uint32_t length = 0;
+            
+            if(rng() & 1){
+                length = DMA_RB_cursorRead(cursor, buf, STRESS_CELL * (1 + rng() % 64));
+            }else{
+                void * ptr;
+                uint32_t available = DMA_RB_cursorGetPtr(cursor, &ptr);
+                if(available > 8192) available = 8192;
+                available -= available % STRESS_CELL;
+                memcpy(buf, ptr, available);
+                length = DMA_RB_cursorAdvance(cursor, available);
+            }
+            
+            xSemaphoreGive(stressResizeGate);
+            
+            //a new cursor starts wherever the stream is at the moment
+            if(first && length > 0){
+                memcpy(&stream.lastSeq, buf, sizeof(uint32_t));
+                stream.lastSeq--;
+                stream.lossMark = mark;
+                first = 0;
+            }
+            stressCheckCells(&stream, buf, length, mark, cursor->overrunBytes + stressRx->lostBytes);
+            
+            if((rng() & 15) == 0) DMA_RB_cursorWait(cursor, 2);
+            stressTasks[index].ops++;
+        }
+        
+        DMA_RB_detachCursor(cursor);
+    }
+    
+    vPortFree(buf);
+}
+
+static void stressTxTask(uint32_t index){
+    uint32_t seq = 0;
+    uint32_t cells[64];
+    
+    while(!stressStop){
+        uint32_t action = rng() % 10000;
+        
+        if(action < 5){
+            DMA_RB_flush(stressTx);
+        }else if(action < 1000){
+            vTaskDelay(0);
+        }else{
+            //only whole cells go into the ring, so the cells never get split between two transfers
+            uint32_t count = 1 + rng() % 64;
+            uint32_t bytes = count * STRESS_CELL;
+            DMA_RB_Span_t span;
+            
+            if(rng() & 1){
+                if(DMA_RB_reserve(stressTx, bytes, &span, 0) < bytes){
+                    taskYIELD();
+                    continue;
+                }
+                for(uint32_t i = 0; i < count; i++) cells[i] = seq + 1 + i;
+                if(DMA_RB_write(stressTx, (uint8_t *) cells, bytes) != bytes) stressFail("tx: DMA_RB_write wrote less than it reserved");
+            }else{
+                uint32_t length = DMA_RB_reserve(stressTx, bytes, &span, DMA_RB_RESERVE_CONTIGUOUS);
+                if(length < bytes){
+                    taskYIELD();
+                    continue;
+                }
+                for(uint32_t i = 0; i < count; i++){
+                    uint32_t value = seq + 1 + i;
+                    memcpy((uint8_t *) span.ptr[0] + i * STRESS_CELL, &value, sizeof(value));
+                }
+                DMA_RB_commit(stressTx, bytes);
+            }
+            seq += count;
+        }
+        
+        stressTasks[index].ops++;
+    }
+}
+
+static void * stressTaskThread(void * params){
+    StressTask_t * task = (StressTask_t *) params;
+    rngState = optSeed * 2654435761u + task->index * 40503 + 17;
+    if(rngState == 0) rngState = 1;
+    shimIsTask = 1;
+    
+    cpuAcquire();
+    shimSetIRQMasked(0);
+    task->function(task->index);
+    shimSetIRQMasked(1);
+    cpuRelease();
+    
+    return NULL;
+}
+
+static void stressAddTask(const char * name, void (* function)(uint32_t index)){
+    StressTask_t * task = &stressTasks[stressTaskCount];
+    task->name = name;
+    task->function = function;
+    task->index = stressTaskCount++;
+    task->ops = 0;
+}
+
+static void stressSetup(){
+    //the ring pointer can only be given out once the channel is running, the dma thread reads it
+    DMA_RingBufferHandle_t * rx = DMA_createRingBuffer(256, STRESS_CELL, (uint32_t *) &hwPeriph->rxA, HW_IRQ_RX_READY, 1, RINGBUFFER_DIRECTION_RX);
+    DMA_RingBufferHandle_t * tx = DMA_createRingBuffer(512, STRESS_CELL, (uint32_t *) &hwPeriph->tx, HW_IRQ_TX_READY, 1, RINGBUFFER_DIRECTION_TX);
+    if(rx == NULL || tx == NULL){
+        stressFail("couldn't create the rings");
+        return;
+    }
+    
+    hwLockTake();
+    stressRx = rx;
+    stressTx = tx;
+    stressTxLastLost = tx->lostBytes;
+    hwLockGive();
+    
+    DMA_RB_setAbortIRQ(rx, HW_IRQ_RX_ABORT, 1);
+    stressResizeGate = xSemaphoreCreateMutex();
+}
+
+static void stressSetupSignals(){
+    hwPageSize = sysconf(_SC_PAGESIZE);
+    hwTrapRegs = mmap(NULL, hwPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(hwTrapRegs == MAP_FAILED){
+        perror("mmap");
+        exit(2);
+    }
+    mprotect(hwTrapRegs, hwPageSize, PROT_READ);
+    
+    //no interrupt may come in while a register write is in flight, the isr would write to the unprotected page or fault from within the trap handler
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaddset(&action.sa_mask, SHIM_IRQ_SIGNAL);
+    
+    action.sa_sigaction = hwSegvHandler;
+    sigaction(SIGSEGV, &action, NULL);
+    action.sa_sigaction = hwTrapHandler;
+    sigaction(SIGTRAP, &action, NULL);
+    
+    action.sa_flags = 0;
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = shimIRQHandler;
+    sigaction(SHIM_IRQ_SIGNAL, &action, NULL);
+    
+    //only tasks take interrupts, every other thread inherits the blocked signal
+    shimSetIRQMasked(1);
+}
+
+static uint64_t stressOps(){
+    uint64_t ops = 0;
+    for(uint32_t i = 0; i < stressTaskCount; i++) ops += stressTasks[i].ops;
+    return ops;
+}
+
+int main(int argc, char ** argv){
+    int opt;
+    while((opt = getopt(argc, argv, "t:s:c:r:q")) != -1){
+        switch(opt){
+            case 't':
+                optSeconds = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                optSeed = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                optChurnTasks = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                optCursorTasks = strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                optQuiet = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t seconds] [-s seed] [-c churnTasks] [-r cursorTasks] [-q]\n", argv[0]);
+                return 2;
+        }
+    }
+    if(optChurnTasks + optCursorTasks + 2 > STRESS_MAX_TASKS){
+        fprintf(stderr, "too many tasks, at most %d\n", STRESS_MAX_TASKS - 2);
+        return 2;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &shimStartTime);
+    shimHeapTop = hwMemory + HW_PERIPH_SIZE;
+    hwCurrentChannel = HW_CHANNELCOUNT;
+    rngState = optSeed ? optSeed : 1;
+    sem_init(&cpuToken, 0, 1);
+    stressSetupSignals();
+    
+    cpuAcquire();
+    stressSetup();
+    cpuRelease();
+    if(stressFailed) return 1;
+    
+    stressAddTask("rx", stressRxTask);
+    stressAddTask("tx", stressTxTask);
+    for(uint32_t i = 0; i < optCursorTasks; i++) stressAddTask("cursor", stressCursorTask);
+    for(uint32_t i = 0; i < optChurnTasks; i++) stressAddTask("churn", stressChurnTask);
+    
+    pthread_t dmaThread;
+    pthread_t interruptThread;
+    pthread_create(&dmaThread, NULL, hwDmaThread, NULL);
+    pthread_create(&interruptThread, NULL, hwInterruptThread, NULL);
+    for(uint32_t i = 0; i < stressTaskCount; i++) pthread_create(&stressTasks[i].thread, NULL, stressTaskThread, &stressTasks[i]);
+    
+    //once a second: throughput, and every task has to have moved on. A task that doesn't is stuck
+    uint64_t lastTaskOps[STRESS_MAX_TASKS] = {0};
+    uint32_t stalled[STRESS_MAX_TASKS] = {0};
+    uint64_t lastOps = 0, lastCells = 0, lastIsrs = 0;
+    for(uint32_t second = 1; second <= optSeconds && !stressStop; second++){
+        shimSleep(1000000);
+        
+        uint64_t ops = stressOps();
+        uint64_t cells = stressCount.cells;
+        uint64_t isrs = stressCount.isrs;
+        if(!optQuiet) printf("%4us  %10llu ops/s  %10llu cells/s  %10llu isrs/s\n", second, (unsigned long long) (ops - lastOps), (unsigned long long) (cells - lastCells), (unsigned long long) (isrs - lastIsrs));
+        lastOps = ops;
+        lastCells = cells;
+        lastIsrs = isrs;
+        
+        for(uint32_t i = 0; i < stressTaskCount; i++){
+            stalled[i] = (stressTasks[i].ops == lastTaskOps[i]) ? stalled[i] + 1 : 0;
+            lastTaskOps[i] = stressTasks[i].ops;
+            if(stalled[i] >= 5) stressFail("task %u (%s) made no progress for %u seconds", i, stressTasks[i].name, stalled[i]);
+        }
+    }
+    
+    stressStop = 1;
+    for(uint32_t i = 0; i < stressTaskCount; i++) pthread_join(stressTasks[i].thread, NULL);
+    pthread_join(interruptThread, NULL);
+    pthread_join(dmaThread, NULL);
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - shimStartTime.tv_sec) + (now.tv_nsec - shimStartTime.tv_nsec) / 1e9;
+    
+    printf("%s after %.1fs: %.0f ops/s, %.0f cells/s, %.0f isrs/s (seed %u)\n", stressFailed ? "FAILED" : "passed", elapsed, stressOps() / elapsed, stressCount.cells / elapsed, stressCount.isrs / elapsed, optSeed);
+    for(uint32_t i = 0; i < stressTaskCount; i++) printf("  task %2u %-8s %12llu ops\n", i, stressTasks[i].name, (unsigned long long) stressTasks[i].ops);
+    printf("  rx ring: %u bytes lost, %u aborts    tx ring: %u bytes lost, %u aborts\n", stressRx->lostBytes, stressRx->abortCount, stressTx->lostBytes, stressTx->abortCount);
+    
+    return stressFailed ? 1 : 0;
+}
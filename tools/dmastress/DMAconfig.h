@@ -0,0 +1,30 @@
+//driver configuration for the stress harness (tools/dmastress.c)
+#ifndef DMASTRESS_DMACONFIG_INC
+#define DMASTRESS_DMACONFIG_INC
+
+#include <stdint.h>
+
+extern volatile uint32_t DMA_IEC, DMA_IFSCLR;
+extern volatile uint32_t hwIPC[8], hwISPC[8];
+
+#define DMA_IEC_BASEMASK    0x00000001
+
+#define DMA_IPC_CH0     hwIPC[0]
+#define DMA_IPC_CH1     hwIPC[1]
+#define DMA_IPC_CH2     hwIPC[2]
+#define DMA_IPC_CH3     hwIPC[3]
+#define DMA_IPC_CH4     hwIPC[4]
+#define DMA_IPC_CH5     hwIPC[5]
+#define DMA_IPC_CH6     hwIPC[6]
+#define DMA_IPC_CH7     hwIPC[7]
+
+#define DMA_ISPC_CH0    hwISPC[0]
+#define DMA_ISPC_CH1    hwISPC[1]
+#define DMA_ISPC_CH2    hwISPC[2]
+#define DMA_ISPC_CH3    hwISPC[3]
+#define DMA_ISPC_CH4    hwISPC[4]
+#define DMA_ISPC_CH5    hwISPC[5]
+#define DMA_ISPC_CH6    hwISPC[6]
+#define DMA_ISPC_CH7    hwISPC[7]
+
+#endif
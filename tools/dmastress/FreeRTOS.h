@@ -0,0 +1,32 @@
+//host replacement for the FreeRTOS api the driver uses. Tasks are pthreads that take turns on one simulated cpu, interrupts are signals, see tools/dmastress.c
+#ifndef DMASTRESS_FREERTOS_INC
+#define DMASTRESS_FREERTOS_INC
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "FreeRTOSConfig.h"
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  0
+#define pdPASS  1
+
+#define portMAX_DELAY 0xffffffffUL
+
+void SHIM_assertFailed(const char * file, int line, const char * expr);
+#define configASSERT(x) do{ if(!(x)) SHIM_assertFailed(__FILE__, __LINE__, #x); }while(0)
+
+void * pvPortMalloc(size_t size);
+void vPortFree(void * ptr);
+
+//a woken task gets the cpu once the isr is done
+void SHIM_yieldFromISR(BaseType_t woken);
+#define portEND_SWITCHING_ISR(woken) SHIM_yieldFromISR(woken)
+#define portYIELD_FROM_ISR(woken) SHIM_yieldFromISR(woken)
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef DMASTRESS_FREERTOSCONFIG_INC
+#define DMASTRESS_FREERTOSCONFIG_INC
+
+#define configCPU_CLOCK_HZ          200000000
+#define configTICK_RATE_HZ          1000
+#define configMINIMAL_STACK_SIZE    256
+
+#endif
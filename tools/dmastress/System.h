@@ -0,0 +1,8 @@
+#ifndef DMASTRESS_SYSTEM_INC
+#define DMASTRESS_SYSTEM_INC
+
+//no caches on the host
+#define SYS_makeCoherent(ptr) ((void *) (ptr))
+#define SYS_makeNonCoherent(ptr) ((void *) (ptr))
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef DMASTRESS_SEMPHR_INC
+#define DMASTRESS_SEMPHR_INC
+
+#include "FreeRTOS.h"
+
+typedef struct SHIM_Semaphore * SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t * woken);
+
+#endif
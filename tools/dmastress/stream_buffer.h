@@ -0,0 +1,12 @@
+#ifndef DMASTRESS_STREAMBUFFER_INC
+#define DMASTRESS_STREAMBUFFER_INC
+
+#include "FreeRTOS.h"
+
+//DMA_RB_readSB isn't part of the stress run, this is only here so DMAutils.c links
+typedef struct SHIM_StreamBuffer * StreamBufferHandle_t;
+
+size_t xStreamBufferSend(StreamBufferHandle_t buffer, const void * data, size_t length, TickType_t timeout);
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t buffer);
+
+#endif
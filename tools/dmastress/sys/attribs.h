@@ -0,0 +1,7 @@
+#ifndef DMASTRESS_ATTRIBS_INC
+#define DMASTRESS_ATTRIBS_INC
+
+//the channel ISRs become plain functions, the model calls them when an interrupt fires
+#define __ISR(vector)
+
+#endif
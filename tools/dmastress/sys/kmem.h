@@ -0,0 +1,12 @@
+#ifndef DMASTRESS_KMEM_INC
+#define DMASTRESS_KMEM_INC
+
+#include <stdint.h>
+
+//"physical" addresses are 32 bit offsets from the model's memory, so the registers can hold them on a 64 bit host as well
+extern uint8_t hwMemory[];
+
+#define KVA_TO_PA(v) ((uint32_t) ((uintptr_t) (v) - (uintptr_t) hwMemory))
+#define PA_TO_KVA1(pa) ((void *) (hwMemory + (int32_t) (pa)))
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef DMASTRESS_TASK_INC
+#define DMASTRESS_TASK_INC
+
+#include "FreeRTOS.h"
+
+void taskENTER_CRITICAL(void);
+void taskEXIT_CRITICAL(void);
+UBaseType_t taskENTER_CRITICAL_FROM_ISR(void);
+void taskEXIT_CRITICAL_FROM_ISR(UBaseType_t state);
+
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+void taskYIELD(void);
+
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+void vTaskDelay(TickType_t ticks);
+
+#endif
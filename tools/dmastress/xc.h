@@ -0,0 +1,248 @@
+//host replacement for xc.h, only what the driver needs. The registers live in the channel model in tools/dmastress.c
+#ifndef DMASTRESS_XC_INC
+#define DMASTRESS_XC_INC
+
+#include <stdint.h>
+#include <stddef.h>
+
+//the driver headers only pull in their target parts for xc32
+#define __XC32 1
+
+typedef struct{
+    volatile uint32_t CON;
+    volatile uint32_t ECON;
+    volatile uint32_t INT;
+    volatile uint32_t SSIZ;
+    volatile uint32_t DSIZ;
+    volatile uint32_t CSIZ;
+    volatile uint32_t SPTR;
+    volatile uint32_t DPTR;
+    volatile uint32_t CPTR;
+    volatile uint32_t DAT;
+} HW_ChannelRegs_t;
+
+//registers with a side effect on write. They sit on a write protected page, so every write traps into the model and takes effect right away
+typedef struct{
+    volatile uint32_t CONCLR;
+    volatile uint32_t CONSET;
+    volatile uint32_t ECONSET;
+    volatile uint32_t INTCLR;
+    volatile uint32_t INTSET;
+    volatile uint32_t SSA;
+    volatile uint32_t DSA;
+} HW_ChannelTrapRegs_t;
+
+#define HW_CHANNELCOUNT 8
+
+extern HW_ChannelRegs_t hwChannel[HW_CHANNELCOUNT];
+extern HW_ChannelTrapRegs_t * hwTrapRegs;
+
+#define DCH0CON      hwChannel[0].CON
+#define DCH0CONCLR   hwTrapRegs[0].CONCLR
+#define DCH0CONSET   hwTrapRegs[0].CONSET
+#define DCH0ECON     hwChannel[0].ECON
+#define DCH0ECONSET  hwTrapRegs[0].ECONSET
+#define DCH0INT      hwChannel[0].INT
+#define DCH0INTCLR   hwTrapRegs[0].INTCLR
+#define DCH0INTSET   hwTrapRegs[0].INTSET
+#define DCH0SSA      hwTrapRegs[0].SSA
+#define DCH0DSA      hwTrapRegs[0].DSA
+#define DCH0SSIZ     hwChannel[0].SSIZ
+#define DCH0DSIZ     hwChannel[0].DSIZ
+#define DCH0CSIZ     hwChannel[0].CSIZ
+#define DCH0SPTR     hwChannel[0].SPTR
+#define DCH0DPTR     hwChannel[0].DPTR
+#define DCH0CPTR     hwChannel[0].CPTR
+#define DCH0DAT      hwChannel[0].DAT
+
+#define DCH1CON      hwChannel[1].CON
+#define DCH1CONCLR   hwTrapRegs[1].CONCLR
+#define DCH1CONSET   hwTrapRegs[1].CONSET
+#define DCH1ECON     hwChannel[1].ECON
+#define DCH1ECONSET  hwTrapRegs[1].ECONSET
+#define DCH1INT      hwChannel[1].INT
+#define DCH1INTCLR   hwTrapRegs[1].INTCLR
+#define DCH1INTSET   hwTrapRegs[1].INTSET
+#define DCH1SSA      hwTrapRegs[1].SSA
+#define DCH1DSA      hwTrapRegs[1].DSA
+#define DCH1SSIZ     hwChannel[1].SSIZ
+#define DCH1DSIZ     hwChannel[1].DSIZ
+#define DCH1CSIZ     hwChannel[1].CSIZ
+#define DCH1SPTR     hwChannel[1].SPTR
+#define DCH1DPTR     hwChannel[1].DPTR
+#define DCH1CPTR     hwChannel[1].CPTR
+#define DCH1DAT      hwChannel[1].DAT
+
+#define DCH2CON      hwChannel[2].CON
+#define DCH2CONCLR   hwTrapRegs[2].CONCLR
+#define DCH2CONSET   hwTrapRegs[2].CONSET
+#define DCH2ECON     hwChannel[2].ECON
+#define DCH2ECONSET  hwTrapRegs[2].ECONSET
+#define DCH2INT      hwChannel[2].INT
+#define DCH2INTCLR   hwTrapRegs[2].INTCLR
+#define DCH2INTSET   hwTrapRegs[2].INTSET
+#define DCH2SSA      hwTrapRegs[2].SSA
+#define DCH2DSA      hwTrapRegs[2].DSA
+#define DCH2SSIZ     hwChannel[2].SSIZ
+#define DCH2DSIZ     hwChannel[2].DSIZ
+#define DCH2CSIZ     hwChannel[2].CSIZ
+#define DCH2SPTR     hwChannel[2].SPTR
+#define DCH2DPTR     hwChannel[2].DPTR
+#define DCH2CPTR     hwChannel[2].CPTR
+#define DCH2DAT      hwChannel[2].DAT
+
+#define DCH3CON      hwChannel[3].CON
+#define DCH3CONCLR   hwTrapRegs[3].CONCLR
+#define DCH3CONSET   hwTrapRegs[3].CONSET
+#define DCH3ECON     hwChannel[3].ECON
+#define DCH3ECONSET  hwTrapRegs[3].ECONSET
+#define DCH3INT      hwChannel[3].INT
+#define DCH3INTCLR   hwTrapRegs[3].INTCLR
+#define DCH3INTSET   hwTrapRegs[3].INTSET
+#define DCH3SSA      hwTrapRegs[3].SSA
+#define DCH3DSA      hwTrapRegs[3].DSA
+#define DCH3SSIZ     hwChannel[3].SSIZ
+#define DCH3DSIZ     hwChannel[3].DSIZ
+#define DCH3CSIZ     hwChannel[3].CSIZ
+#define DCH3SPTR     hwChannel[3].SPTR
+#define DCH3DPTR     hwChannel[3].DPTR
+#define DCH3CPTR     hwChannel[3].CPTR
+#define DCH3DAT      hwChannel[3].DAT
+
+#define DCH4CON      hwChannel[4].CON
+#define DCH4CONCLR   hwTrapRegs[4].CONCLR
+#define DCH4CONSET   hwTrapRegs[4].CONSET
+#define DCH4ECON     hwChannel[4].ECON
+#define DCH4ECONSET  hwTrapRegs[4].ECONSET
+#define DCH4INT      hwChannel[4].INT
+#define DCH4INTCLR   hwTrapRegs[4].INTCLR
+#define DCH4INTSET   hwTrapRegs[4].INTSET
+#define DCH4SSA      hwTrapRegs[4].SSA
+#define DCH4DSA      hwTrapRegs[4].DSA
+#define DCH4SSIZ     hwChannel[4].SSIZ
+#define DCH4DSIZ     hwChannel[4].DSIZ
+#define DCH4CSIZ     hwChannel[4].CSIZ
+#define DCH4SPTR     hwChannel[4].SPTR
+#define DCH4DPTR     hwChannel[4].DPTR
+#define DCH4CPTR     hwChannel[4].CPTR
+#define DCH4DAT      hwChannel[4].DAT
+
+#define DCH5CON      hwChannel[5].CON
+#define DCH5CONCLR   hwTrapRegs[5].CONCLR
+#define DCH5CONSET   hwTrapRegs[5].CONSET
+#define DCH5ECON     hwChannel[5].ECON
+#define DCH5ECONSET  hwTrapRegs[5].ECONSET
+#define DCH5INT      hwChannel[5].INT
+#define DCH5INTCLR   hwTrapRegs[5].INTCLR
+#define DCH5INTSET   hwTrapRegs[5].INTSET
+#define DCH5SSA      hwTrapRegs[5].SSA
+#define DCH5DSA      hwTrapRegs[5].DSA
+#define DCH5SSIZ     hwChannel[5].SSIZ
+#define DCH5DSIZ     hwChannel[5].DSIZ
+#define DCH5CSIZ     hwChannel[5].CSIZ
+#define DCH5SPTR     hwChannel[5].SPTR
+#define DCH5DPTR     hwChannel[5].DPTR
+#define DCH5CPTR     hwChannel[5].CPTR
+#define DCH5DAT      hwChannel[5].DAT
+
+#define DCH6CON      hwChannel[6].CON
+#define DCH6CONCLR   hwTrapRegs[6].CONCLR
+#define DCH6CONSET   hwTrapRegs[6].CONSET
+#define DCH6ECON     hwChannel[6].ECON
+#define DCH6ECONSET  hwTrapRegs[6].ECONSET
+#define DCH6INT      hwChannel[6].INT
+#define DCH6INTCLR   hwTrapRegs[6].INTCLR
+#define DCH6INTSET   hwTrapRegs[6].INTSET
+#define DCH6SSA      hwTrapRegs[6].SSA
+#define DCH6DSA      hwTrapRegs[6].DSA
+#define DCH6SSIZ     hwChannel[6].SSIZ
+#define DCH6DSIZ     hwChannel[6].DSIZ
+#define DCH6CSIZ     hwChannel[6].CSIZ
+#define DCH6SPTR     hwChannel[6].SPTR
+#define DCH6DPTR     hwChannel[6].DPTR
+#define DCH6CPTR     hwChannel[6].CPTR
+#define DCH6DAT      hwChannel[6].DAT
+
+#define DCH7CON      hwChannel[7].CON
+#define DCH7CONCLR   hwTrapRegs[7].CONCLR
+#define DCH7CONSET   hwTrapRegs[7].CONSET
+#define DCH7ECON     hwChannel[7].ECON
+#define DCH7ECONSET  hwTrapRegs[7].ECONSET
+#define DCH7INT      hwChannel[7].INT
+#define DCH7INTCLR   hwTrapRegs[7].INTCLR
+#define DCH7INTSET   hwTrapRegs[7].INTSET
+#define DCH7SSA      hwTrapRegs[7].SSA
+#define DCH7DSA      hwTrapRegs[7].DSA
+#define DCH7SSIZ     hwChannel[7].SSIZ
+#define DCH7DSIZ     hwChannel[7].DSIZ
+#define DCH7CSIZ     hwChannel[7].CSIZ
+#define DCH7SPTR     hwChannel[7].SPTR
+#define DCH7DPTR     hwChannel[7].DPTR
+#define DCH7CPTR     hwChannel[7].CPTR
+#define DCH7DAT      hwChannel[7].DAT
+extern volatile uint32_t DMACON, DMACONSET, DMACONCLR, IEC4;
+typedef struct{
+    uint32_t DMABUSY;
+} HW_DMACONbits_t;
+extern HW_DMACONbits_t DMACONbits;
+
+#define _DCH0CON_CHPRI_POSITION     0
+#define _DCH0CON_CHPRI_MASK         0x00000003
+#define _DCH0CON_CHEDET_MASK        0x00000004
+#define _DCH0CON_CHAEN_MASK         0x00000010
+#define _DCH0CON_CHCHN_MASK         0x00000020
+#define _DCH0CON_CHAED_MASK         0x00000040
+#define _DCH0CON_CHEN_MASK          0x00000080
+#define _DCH0CON_CHCHNS_MASK        0x00000100
+#define _DCH0CON_CHBUSY_MASK        0x00008000
+
+#define _DCH0ECON_AIRQEN_MASK       0x00000008
+#define _DCH0ECON_SIRQEN_MASK       0x00000010
+#define _DCH0ECON_PATEN_MASK        0x00000020
+#define _DCH0ECON_CABORT_MASK       0x00000040
+#define _DCH0ECON_CFORCE_MASK       0x00000080
+#define _DCH0ECON_CHSIRQ_POSITION   8
+#define _DCH0ECON_CHSIRQ_MASK       0x0000ff00
+#define _DCH0ECON_CHAIRQ_POSITION   16
+#define _DCH0ECON_CHAIRQ_MASK       0x00ff0000
+
+#define _DCH0INT_CHERIF_MASK        0x00000001
+#define _DCH0INT_CHTAIF_MASK        0x00000002
+#define _DCH0INT_CHCCIF_MASK        0x00000004
+#define _DCH0INT_CHBCIF_MASK        0x00000008
+#define _DCH0INT_CHDHIF_MASK        0x00000010
+#define _DCH0INT_CHDDIF_MASK        0x00000020
+#define _DCH0INT_CHSHIF_MASK        0x00000040
+#define _DCH0INT_CHSDIF_MASK        0x00000080
+#define _DCH0INT_CHERIE_MASK        0x00010000
+#define _DCH0INT_CHTAIE_MASK        0x00020000
+#define _DCH0INT_CHCCIE_MASK        0x00040000
+#define _DCH0INT_CHBCIE_MASK        0x00080000
+#define _DCH0INT_CHDHIE_MASK        0x00100000
+#define _DCH0INT_CHDDIE_MASK        0x00200000
+#define _DCH0INT_CHSHIE_MASK        0x00400000
+#define _DCH0INT_CHSDIE_MASK        0x00800000
+
+#define _DMACON_SUSPEND_MASK        0x00001000
+
+#define _IFS1_DMA0IF_MASK           0x00010000
+
+#define _DMA0_IRQ   134
+#define _DMA1_IRQ   135
+#define _DMA2_IRQ   136
+#define _DMA3_IRQ   137
+
+#define _DMA0_VECTOR    134
+#define _DMA1_VECTOR    135
+#define _DMA2_VECTOR    136
+#define _DMA3_VECTOR    137
+#define _DMA4_VECTOR    138
+#define _DMA5_VECTOR    139
+#define _DMA6_VECTOR    140
+#define _DMA7_VECTOR    141
+
+static inline uint32_t _CP0_GET_COUNT(void){
+    return 0;
+}
+
+#endif
@@ -0,0 +1,256 @@
+//decoder for dumps written by DMA_traceDump. Runs on the pc, build with
+//  cc -O2 -o dmatrace tools/dmatrace.c
+//usage: dmatrace [-s] [-c channel] [dumpfile]     (reads stdin if no file is given, -s only prints the summary)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/DMAtrace.h"
+
+#define MAX_CHANNELS 256
+
+typedef struct{
+    uint32_t events;
+    uint32_t isrCount;
+    uint32_t aborts;
+    
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t bytesDropped;
+    uint64_t firstData;
+    uint64_t lastData;
+    
+    //time between consecutive interrupts
+    uint64_t lastIsr;
+    uint64_t isrGapMin;
+    uint64_t isrGapMax;
+    uint64_t isrGapSum;
+    uint32_t isrGapCount;
+    
+    //time from an interrupt to the next read of the ring buffer
+    uint32_t pendingIsr;
+    uint64_t latencyMin;
+    uint64_t latencyMax;
+    uint64_t latencySum;
+    uint32_t latencyCount;
+} ChannelStats_t;
+
+static uint32_t readLE32(const uint8_t * p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static const char * eventName(uint32_t type){
+    switch(type){
+        case DMA_TRACE_EVT_ALLOC:       return "ALLOC";
+        case DMA_TRACE_EVT_FREE:        return "FREE";
+        case DMA_TRACE_EVT_CFG_SRC:     return "CFG_SRC";
+        case DMA_TRACE_EVT_CFG_DST:     return "CFG_DST";
+        case DMA_TRACE_EVT_CFG_XFER:    return "CFG_XFER";
+        case DMA_TRACE_EVT_CFG_CHAN:    return "CFG_CHAN";
+        case DMA_TRACE_EVT_CFG_INT:     return "CFG_INT";
+        case DMA_TRACE_EVT_ISR:         return "ISR";
+        case DMA_TRACE_EVT_ABORT:       return "ABORT";
+        case DMA_TRACE_EVT_RB_READ:     return "RB_READ";
+        case DMA_TRACE_EVT_RB_WRITE:    return "RB_WRITE";
+        case DMA_TRACE_EVT_RB_FLUSH:    return "RB_FLUSH";
+        default:                        return "?";
+    }
+}
+
+static void printDetails(uint32_t type, uint32_t arg16, uint32_t arg32){
+    switch(type){
+        case DMA_TRACE_EVT_ALLOC:
+            printf("handle=0x%08x", arg32);
+            break;
+        case DMA_TRACE_EVT_CFG_SRC:
+        case DMA_TRACE_EVT_CFG_DST:
+            printf("addr=0x%08x size=%u", arg32, arg16);
+            break;
+        case DMA_TRACE_EVT_CFG_XFER:
+            printf("cellSize=%u econ=0x%08x", arg16, arg32);
+            break;
+        case DMA_TRACE_EVT_CFG_CHAN:
+            printf("con=0x%08x prio=%u", arg32, arg32 & 3);
+            break;
+        case DMA_TRACE_EVT_CFG_INT:
+            printf("int=0x%08x", arg32);
+            break;
+        case DMA_TRACE_EVT_ISR:
+            printf("flags=0x%02x%s%s%s%s%s%s%s%s", arg16
+                    , (arg16 & 0x01) ? " ERR" : "", (arg16 & 0x02) ? " ABORT" : "", (arg16 & 0x04) ? " CELL" : ""
+                    , (arg16 & 0x08) ? " BLOCK" : "", (arg16 & 0x10) ? " DHALF" : "", (arg16 & 0x20) ? " DDONE" : ""
+                    , (arg16 & 0x40) ? " SHALF" : "", (arg16 & 0x80) ? " SDONE" : "");
+            break;
+        case DMA_TRACE_EVT_ABORT:
+            printf("flags=0x%02x pos=%u", arg16, arg32);
+            break;
+        case DMA_TRACE_EVT_RB_READ:
+        case DMA_TRACE_EVT_RB_WRITE:
+            printf("bytes=%u pos=%u", arg16, arg32);
+            break;
+        case DMA_TRACE_EVT_RB_FLUSH:
+            printf("dropped=%u", arg32);
+            break;
+    }
+}
+
+static double toUs(uint64_t ticks, uint32_t freq){
+    return (double) ticks * 1e6 / (double) freq;
+}
+
+int main(int argc, char ** argv){
+    int summaryOnly = 0;
+    int channelFilter = -1;
+    const char * fileName = NULL;
+    
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-s") == 0){
+            summaryOnly = 1;
+        }else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc){
+            channelFilter = atoi(argv[++i]);
+        }else if(argv[i][0] == '-' && argv[i][1] != 0){
+            fprintf(stderr, "usage: %s [-s] [-c channel] [dumpfile]\n", argv[0]);
+            return 1;
+        }else{
+            fileName = argv[i];
+        }
+    }
+    
+    FILE * file = stdin;
+    if(fileName != NULL && strcmp(fileName, "-") != 0){
+        file = fopen(fileName, "rb");
+        if(file == NULL){
+            perror(fileName);
+            return 1;
+        }
+    }
+    
+    uint8_t buffer[sizeof(DMA_TraceRecord_t) > sizeof(DMA_TraceHeader_t) ? sizeof(DMA_TraceRecord_t) : sizeof(DMA_TraceHeader_t)];
+    
+    if(fread(buffer, sizeof(DMA_TraceHeader_t), 1, file) != 1 || readLE32(&buffer[0]) != DMA_TRACE_MAGIC){
+        fprintf(stderr, "not a DMA trace dump\n");
+        return 1;
+    }
+    if(readLE32(&buffer[4]) != DMA_TRACE_VERSION){
+        fprintf(stderr, "unsupported trace version %u\n", readLE32(&buffer[4]));
+        return 1;
+    }
+    
+    uint32_t freq = readLE32(&buffer[8]);
+    uint32_t count = readLE32(&buffer[12]);
+    if(freq == 0) freq = 1;
+    
+    static ChannelStats_t stats[MAX_CHANNELS];
+    
+    uint64_t time = 0;
+    uint64_t startTime = 0;
+    uint32_t lastStamp = 0;
+    uint32_t records = 0;
+    
+    for(; records < count; records++){
+        if(fread(buffer, sizeof(DMA_TraceRecord_t), 1, file) != 1){
+            fprintf(stderr, "dump truncated after %u of %u records\n", records, count);
+            break;
+        }
+        
+        uint32_t stamp = readLE32(&buffer[0]);
+        uint32_t type = buffer[4];
+        uint32_t ch = buffer[5];
+        uint32_t arg16 = buffer[6] | (buffer[7] << 8);
+        uint32_t arg32 = readLE32(&buffer[8]);
+        
+        //the core timer is only 32 bits, unwrap it assuming no two records are more than one timer period apart
+        if(records == 0){
+            startTime = stamp;
+            time = stamp;
+        }else{
+            time += (uint32_t) (stamp - lastStamp);
+        }
+        lastStamp = stamp;
+        
+        if(channelFilter >= 0 && (int) ch != channelFilter) continue;
+        
+        if(!summaryOnly){
+            printf("%14.3f us  ch%-3u %-9s ", toUs(time - startTime, freq), ch, eventName(type));
+            printDetails(type, arg16, arg32);
+            printf("\n");
+        }
+        
+        ChannelStats_t * s = &stats[ch];
+        s->events++;
+        
+        switch(type){
+            case DMA_TRACE_EVT_ISR:
+                if(s->isrCount > 0){
+                    uint64_t gap = time - s->lastIsr;
+                    if(s->isrGapCount == 0 || gap < s->isrGapMin) s->isrGapMin = gap;
+                    if(gap > s->isrGapMax) s->isrGapMax = gap;
+                    s->isrGapSum += gap;
+                    s->isrGapCount++;
+                }
+                s->isrCount++;
+                s->lastIsr = time;
+                s->pendingIsr = 1;
+                break;
+                
+            case DMA_TRACE_EVT_ABORT:
+                s->aborts++;
+                break;
+                
+            case DMA_TRACE_EVT_RB_READ:
+            case DMA_TRACE_EVT_RB_WRITE:
+                if(s->bytesRead + s->bytesWritten == 0) s->firstData = time;
+                s->lastData = time;
+                
+                if(type == DMA_TRACE_EVT_RB_WRITE){
+                    s->bytesWritten += arg16;
+                    break;
+                }
+                s->bytesRead += arg16;
+                
+                if(s->pendingIsr && arg16 != 0){
+                    uint64_t latency = time - s->lastIsr;
+                    if(s->latencyCount == 0 || latency < s->latencyMin) s->latencyMin = latency;
+                    if(latency > s->latencyMax) s->latencyMax = latency;
+                    s->latencySum += latency;
+                    s->latencyCount++;
+                    s->pendingIsr = 0;
+                }
+                break;
+                
+            case DMA_TRACE_EVT_RB_FLUSH:
+                s->bytesDropped += arg32;
+                break;
+        }
+    }
+    
+    if(file != stdin) fclose(file);
+    
+    printf("\n%u records, %.3f ms, timer at %u Hz\n", records, toUs(time - startTime, freq) / 1000.0, freq);
+    
+    for(uint32_t ch = 0; ch < MAX_CHANNELS; ch++){
+        ChannelStats_t * s = &stats[ch];
+        if(s->events == 0) continue;
+        
+        printf("\nchannel %u: %u events, %u interrupts, %u aborts\n", ch, s->events, s->isrCount, s->aborts);
+        
+        if(s->bytesRead + s->bytesWritten != 0){
+            double span = toUs(s->lastData - s->firstData, freq) / 1e6;
+            printf("  data:       %llu bytes read, %llu bytes written, %llu dropped", (unsigned long long) s->bytesRead, (unsigned long long) s->bytesWritten, (unsigned long long) s->bytesDropped);
+            if(span > 0) printf(", %.1f kB/s", (double) (s->bytesRead + s->bytesWritten) / span / 1000.0);
+            printf("\n");
+        }
+        
+        if(s->isrGapCount != 0){
+            printf("  isr period: min %.3f us, avg %.3f us, max %.3f us\n", toUs(s->isrGapMin, freq), toUs(s->isrGapSum / s->isrGapCount, freq), toUs(s->isrGapMax, freq));
+        }
+        
+        if(s->latencyCount != 0){
+            printf("  isr->read:  min %.3f us, avg %.3f us, max %.3f us\n", toUs(s->latencyMin, freq), toUs(s->latencySum / s->latencyCount, freq), toUs(s->latencyMax, freq));
+        }
+    }
+    
+    return 0;
+}